@@ -0,0 +1,692 @@
+/*
+ * Throughput and latency benchmark, run once per selected backend (by
+ * default the one swiss_table_init picks):
+ *
+ *   gcc -O2 -fopenmp -pthread -o bench bench.c swiss_table.c cons/swiss_table.c simd/swiss_table.c parallel/swiss_table.c -lm
+ *   ./bench [--sizes 1000,1000000,100000000] [--ops N] [--keys short,long] [--backends cons,simd,parallel] [--threads N] [--seed N] [--perf] [--csv]
+ *
+ * Operations run in batches of BENCH_BATCH. Keys of a batch are formatted
+ * before its clock starts, so neither key formatting nor the clock itself
+ * is measured. Latency percentiles are taken over the per-operation mean
+ * of each batch.
+ *
+ * --perf adds hardware counters (Linux perf_event_open) per operation:
+ * instructions, IPC, L1D/LLC/dTLB read misses and branch misses. They run
+ * only while a batch is timed and cover the benchmark thread only, so
+ * OpenMP workers of the parallel backend are not counted. Counters the
+ * kernel refuses (no PMU in a VM or container, perf_event_paranoid) are
+ * reported as "-" (empty in CSV).
+ *
+ * --threads N also runs the sharded concurrent table on N OpenMP threads,
+ * reported as backend "conc/N": every key inserted, then a uniform
+ * 90/9/1 mix. Each thread takes an equal share of the operations;
+ * throughput is all operations over wall time and the percentiles pool
+ * the batches of every thread. Perf counters are reported as missing.
+ */
+#include "swiss_table.h"
+#include "swiss_table_concurrent.h"
+#include <errno.h>
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_BATCH 64
+#define KEY_SIZE 48
+#define ZIPF_THETA 0.99
+/* zeta(n) is summed exactly up to here and extended with its integral beyond. */
+#define ZETA_EXACT_TERMS (1u << 20)
+
+enum key_kind
+{
+  KEYS_SHORT = 1,
+  KEYS_LONG = 2
+};
+
+enum distribution
+{
+  DIST_UNIFORM = 0,
+  DIST_ZIPF
+};
+
+enum op_kind
+{
+  OP_GET = 0,
+  OP_INSERT,
+  OP_DELETE
+};
+
+typedef struct bench_config
+{
+  size_t sizes[16];
+  size_t size_count;
+  size_t ops;
+  uint8_t keys;
+  uint8_t backends;
+  uint8_t perf;
+  uint8_t csv;
+  uint32_t threads;
+  uint64_t seed;
+} bench_config_t;
+
+/*
+ * Scrambled Zipfian ranks over [0, n) after Gray et al. ("Quickly
+ * generating billion-record synthetic databases"), as used by YCSB.
+ */
+typedef struct zipf
+{
+  uint64_t _n;
+  double _alpha;
+  double _zetan;
+  double _eta;
+} zipf_t;
+
+/* One workload: every operation draws a key index and an operation kind. */
+typedef struct workload
+{
+  const char* _name;
+  enum distribution _dist;
+  double _hit_ratio;
+  /* Percent of reads, writes and deletes; reads only if all are 0. */
+  uint8_t _write_pct;
+  uint8_t _delete_pct;
+  /* Keys looked up per swiss_table_get_batch call, 0 for single calls. */
+  uint32_t _get_batch;
+  /* Key indexes are drawn from [0, key_space * n). */
+  uint32_t _key_space;
+} workload_t;
+
+enum perf_event_kind
+{
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_L1_MISSES,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_EVENT_COUNT
+};
+
+/* Raw reading of one counter: count, then time enabled and time running. */
+typedef struct perf_sample
+{
+  uint64_t _value;
+  uint64_t _enabled;
+  uint64_t _running;
+} perf_sample_t;
+
+/*
+ * One fd per event rather than a group, so the kernel can multiplex them
+ * on a PMU with fewer counters; counts are scaled by enabled / running
+ * time. All of them are switched together with a single prctl.
+ */
+typedef struct perf_counters
+{
+  int _fds[PERF_EVENT_COUNT];
+  uint8_t _open;
+} perf_counters_t;
+
+typedef struct bench_result
+{
+  size_t _ops;
+  double _seconds;
+  double* _batch_ns;
+  size_t _batches;
+  /* Scaled counts of the phase so far, negative if the counter never ran. */
+  double _events[PERF_EVENT_COUNT];
+} bench_result_t;
+
+static volatile size_t bench_sink;
+
+static perf_counters_t bench_perf = { { -1, -1, -1, -1, -1, -1 }, 0 };
+
+#if defined(__linux__)
+static int
+perf_open_event(uint32_t type, uint64_t config)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t
+perf_cache_miss(uint64_t cache)
+{
+  return cache | ((uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8) | ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+/* Opens whichever counters the kernel allows; returns how many. */
+static size_t
+perf_open(perf_counters_t* perf)
+{
+  size_t opened = 0;
+#if defined(__linux__)
+  static const struct
+  {
+    uint32_t _type;
+    uint64_t _config;
+  } events[PERF_EVENT_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  };
+  for (int event = 0; event < PERF_EVENT_COUNT; ++event) {
+    uint64_t config = events[event]._type == PERF_TYPE_HW_CACHE ? perf_cache_miss(events[event]._config) : events[event]._config;
+    perf->_fds[event] = perf_open_event(events[event]._type, config);
+    opened += perf->_fds[event] >= 0;
+  }
+#else
+  errno = ENOSYS;
+#endif
+  perf->_open = opened > 0;
+  return opened;
+}
+
+static void
+perf_close(perf_counters_t* perf)
+{
+#if defined(__linux__)
+  for (int event = 0; event < PERF_EVENT_COUNT; ++event) {
+    if (perf->_fds[event] >= 0) {
+      close(perf->_fds[event]);
+      perf->_fds[event] = -1;
+    }
+  }
+#endif
+  perf->_open = 0;
+}
+
+/* Switches every counter opened by this process on or off. */
+static inline void
+perf_enable(uint8_t enable)
+{
+#if defined(__linux__)
+  if (bench_perf._open) {
+    prctl(enable ? PR_TASK_PERF_EVENTS_ENABLE : PR_TASK_PERF_EVENTS_DISABLE, 0, 0, 0, 0);
+  }
+#else
+  (void)enable;
+#endif
+}
+
+static void
+perf_read(perf_sample_t* samples)
+{
+  memset(samples, 0, PERF_EVENT_COUNT * sizeof(perf_sample_t));
+#if defined(__linux__)
+  for (int event = 0; event < PERF_EVENT_COUNT; ++event) {
+    if (bench_perf._fds[event] >= 0 && read(bench_perf._fds[event], &samples[event], sizeof(perf_sample_t)) != sizeof(perf_sample_t)) {
+      memset(&samples[event], 0, sizeof(perf_sample_t));
+    }
+  }
+#endif
+}
+
+/* Adds the counts between two readings, scaled up for time spent multiplexed out. */
+static void
+perf_accumulate(bench_result_t* result, const perf_sample_t* begin, const perf_sample_t* end)
+{
+  for (int event = 0; event < PERF_EVENT_COUNT; ++event) {
+    uint64_t running = end[event]._running - begin[event]._running;
+    if (!running) {
+      continue;
+    }
+    double scale = (double)(end[event]._enabled - begin[event]._enabled) / running;
+    result->_events[event] = (result->_events[event] < 0 ? 0 : result->_events[event]) + (end[event]._value - begin[event]._value) * scale;
+  }
+}
+
+static void
+perf_reset(bench_result_t* result)
+{
+  for (int event = 0; event < PERF_EVENT_COUNT; ++event) {
+    result->_events[event] = -1;
+  }
+}
+
+static inline uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* splitmix64 */
+static inline uint64_t
+rng_next(uint64_t* state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static inline double
+rng_unit(uint64_t* state)
+{
+  return (rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double
+zeta(uint64_t n, double theta)
+{
+  double sum = 0;
+  uint64_t exact = n < ZETA_EXACT_TERMS ? n : ZETA_EXACT_TERMS;
+  for (uint64_t i = 1; i <= exact; ++i) {
+    sum += 1.0 / pow((double)i, theta);
+  }
+  if (n > exact) {
+    sum += (pow((double)n, 1 - theta) - pow((double)exact, 1 - theta)) / (1 - theta);
+  }
+  return sum;
+}
+
+static void
+zipf_init(zipf_t* zipf, uint64_t n, double theta)
+{
+  zipf->_n = n;
+  zipf->_alpha = 1 / (1 - theta);
+  zipf->_zetan = zeta(n, theta);
+  zipf->_eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zipf->_zetan);
+}
+
+static uint64_t
+zipf_next(const zipf_t* zipf, uint64_t* state)
+{
+  double u = rng_unit(state);
+  double uz = u * zipf->_zetan;
+  uint64_t rank;
+  if (uz < 1) {
+    rank = 0;
+  } else if (uz < 1 + pow(0.5, ZIPF_THETA)) {
+    rank = 1;
+  } else {
+    rank = (uint64_t)(zipf->_n * pow(zipf->_eta * u - zipf->_eta + 1, zipf->_alpha));
+  }
+  rank = rank < zipf->_n ? rank : zipf->_n - 1;
+  /* Spread the hot ranks over the key space instead of the first indexes. */
+  uint64_t mixed = rank;
+  return rng_next(&mixed) % zipf->_n;
+}
+
+static size_t
+format_key(char* buf, uint64_t index, uint8_t long_keys)
+{
+  int len = long_keys ? snprintf(buf, KEY_SIZE, "session:%020llu:profile", (unsigned long long)index) : snprintf(buf, KEY_SIZE, "%llu", (unsigned long long)index);
+  return (size_t)len;
+}
+
+static int
+compare_double(const void* lhs, const void* rhs)
+{
+  double a = *(const double*)lhs, b = *(const double*)rhs;
+  return (a > b) - (a < b);
+}
+
+static double
+percentile(const double* sorted, size_t count, double p)
+{
+  return count ? sorted[(size_t)(p * (count - 1))] : 0;
+}
+
+/* Inserts keys [0, n) in index order. */
+static void
+run_insert(swiss_table_t* tbl, size_t n, uint8_t long_keys, bench_result_t* result)
+{
+  char keys[BENCH_BATCH][KEY_SIZE];
+  size_t lens[BENCH_BATCH];
+  perf_sample_t begin[PERF_EVENT_COUNT], end[PERF_EVENT_COUNT];
+  perf_read(begin);
+  for (size_t done = 0; done < n; done += BENCH_BATCH) {
+    size_t count = n - done < BENCH_BATCH ? n - done : BENCH_BATCH;
+    for (size_t op = 0; op < count; ++op) {
+      lens[op] = format_key(keys[op], done + op, long_keys);
+    }
+    perf_enable(1);
+    uint64_t start = now_ns();
+    for (size_t op = 0; op < count; ++op) {
+      bench_sink += swiss_table_insert_update_n(tbl, keys[op], lens[op], keys[op], lens[op]);
+    }
+    uint64_t elapsed = now_ns() - start;
+    perf_enable(0);
+    result->_batch_ns[result->_batches++] = (double)elapsed / count;
+    result->_seconds += elapsed * 1e-9;
+    result->_ops += count;
+  }
+  perf_read(end);
+  perf_accumulate(result, begin, end);
+}
+
+static void
+run_workload(swiss_table_t* tbl, const workload_t* workload, size_t n, size_t ops, uint8_t long_keys, uint64_t* rng, bench_result_t* result)
+{
+  char keys[BENCH_BATCH][KEY_SIZE];
+  const char* key_ptrs[BENCH_BATCH];
+  size_t lens[BENCH_BATCH];
+  uint8_t kinds[BENCH_BATCH];
+  const char* values[BENCH_BATCH];
+  uint64_t key_space = (uint64_t)n * workload->_key_space;
+  zipf_t zipf;
+  if (workload->_dist == DIST_ZIPF) {
+    zipf_init(&zipf, workload->_key_space > 1 ? key_space : n, ZIPF_THETA);
+  }
+  perf_sample_t begin[PERF_EVENT_COUNT], end[PERF_EVENT_COUNT];
+  perf_read(begin);
+  for (size_t done = 0; done < ops; done += BENCH_BATCH) {
+    size_t count = ops - done < BENCH_BATCH ? ops - done : BENCH_BATCH;
+    for (size_t op = 0; op < count; ++op) {
+      uint64_t index;
+      if (workload->_key_space > 1) {
+        index = workload->_dist == DIST_ZIPF ? zipf_next(&zipf, rng) : rng_next(rng) % key_space;
+      } else {
+        /* Misses reuse the hit distribution shifted past the inserted keys. */
+        index = workload->_dist == DIST_ZIPF ? zipf_next(&zipf, rng) : rng_next(rng) % n;
+        index += rng_unit(rng) < workload->_hit_ratio ? 0 : n;
+      }
+      uint64_t roll = rng_next(rng) % 100;
+      kinds[op] = roll < workload->_delete_pct ? OP_DELETE : roll < (uint64_t)workload->_delete_pct + workload->_write_pct ? OP_INSERT : OP_GET;
+      lens[op] = format_key(keys[op], index, long_keys);
+      key_ptrs[op] = keys[op];
+    }
+    perf_enable(1);
+    uint64_t start = now_ns();
+    if (workload->_get_batch) {
+      for (size_t op = 0; op < count; op += workload->_get_batch) {
+        size_t chunk = count - op < workload->_get_batch ? count - op : workload->_get_batch;
+        bench_sink += swiss_table_get_batch(tbl, key_ptrs + op, lens + op, chunk, values + op, NULL);
+      }
+    } else {
+      for (size_t op = 0; op < count; ++op) {
+        switch (kinds[op]) {
+          case OP_GET:
+            bench_sink += swiss_table_get_ref_n(tbl, keys[op], lens[op], NULL) != NULL;
+            break;
+          case OP_INSERT:
+            bench_sink += swiss_table_insert_update_n(tbl, keys[op], lens[op], keys[op], lens[op]);
+            break;
+          default:
+            bench_sink += swiss_table_delete_n(tbl, keys[op], lens[op]);
+            break;
+        }
+      }
+    }
+    uint64_t elapsed = now_ns() - start;
+    perf_enable(0);
+    result->_batch_ns[result->_batches++] = (double)elapsed / count;
+    result->_seconds += elapsed * 1e-9;
+    result->_ops += count;
+  }
+  perf_read(end);
+  perf_accumulate(result, begin, end);
+}
+
+/* Per-operation counts (IPC for cycles), "-" or an empty CSV field if unavailable. */
+static void
+report_perf(const bench_config_t* config, const bench_result_t* result)
+{
+  static const char* const labels[] = { "IPC", "ins", "L1", "LLC", "dTLB", "br" };
+  static const int events[] = { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1_MISSES, PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_BRANCH_MISSES };
+  for (size_t index = 0; index < sizeof(events) / sizeof(events[0]); ++index) {
+    double count = result->_events[events[index]];
+    double value = count < 0 || !result->_ops ? -1 : count / result->_ops;
+    if (events[index] == PERF_CYCLES) {
+      double instructions = result->_events[PERF_INSTRUCTIONS];
+      value = count > 0 && instructions >= 0 ? instructions / count : -1;
+    }
+    if (config->csv) {
+      printf(value < 0 ? "," : ",%.3f", value);
+    } else if (value < 0) {
+      printf("  %s %7s", labels[index], "-");
+    } else {
+      printf(index < 2 ? "  %s %7.2f" : "  %s %7.3f", labels[index], value);
+    }
+  }
+}
+
+static void
+report(const bench_config_t* config, const char* name, const char* workload, size_t n, uint8_t long_keys, const char* dist, double hit_ratio, const char* mix, bench_result_t* result)
+{
+  qsort(result->_batch_ns, result->_batches, sizeof(double), &compare_double);
+  double throughput = result->_seconds > 0 ? result->_ops / result->_seconds : 0;
+  double p50 = percentile(result->_batch_ns, result->_batches, 0.5);
+  double p99 = percentile(result->_batch_ns, result->_batches, 0.99);
+  double p999 = percentile(result->_batch_ns, result->_batches, 0.999);
+  const char* keys = long_keys ? "long" : "short";
+  if (config->csv) {
+    printf("%s,%s,%zu,%s,%s,%.2f,%s,%zu,%.6f,%.0f,%.1f,%.1f,%.1f", name, workload, n, keys, dist, hit_ratio, mix,
+           result->_ops, result->_seconds, throughput, p50, p99, p999);
+  } else {
+    printf("%-10s %-12s %10zu %-5s %-7s %5.2f %-8s %12.0f ops/s  p50 %7.1f ns  p99 %7.1f ns  p99.9 %7.1f ns", name, workload, n, keys, dist,
+           hit_ratio, mix, throughput, p50, p99, p999);
+  }
+  if (config->perf) {
+    report_perf(config, result);
+  }
+  printf("\n");
+  fflush(stdout);
+  result->_ops = 0;
+  result->_seconds = 0;
+  result->_batches = 0;
+  perf_reset(result);
+}
+
+static const workload_t workloads[] = {
+  { "get", DIST_UNIFORM, 1.0, 0, 0, 0, 1 },
+  { "get", DIST_UNIFORM, 0.5, 0, 0, 0, 1 },
+  { "get", DIST_UNIFORM, 0.0, 0, 0, 0, 1 },
+  { "get", DIST_ZIPF, 1.0, 0, 0, 0, 1 },
+  { "get", DIST_ZIPF, 0.5, 0, 0, 0, 1 },
+  { "get_batch16", DIST_UNIFORM, 1.0, 0, 0, 16, 1 },
+  { "get_batch64", DIST_UNIFORM, 1.0, 0, 0, 64, 1 },
+  { "mixed", DIST_UNIFORM, 0.5, 9, 1, 0, 2 },
+  { "mixed", DIST_ZIPF, 0.5, 9, 1, 0, 2 },
+  { "mixed", DIST_UNIFORM, 0.5, 40, 10, 0, 2 },
+  { "mixed", DIST_ZIPF, 0.5, 40, 10, 0, 2 },
+};
+
+static void
+run_size(const bench_config_t* config, uint8_t backend, size_t n, uint8_t long_keys, uint64_t* rng)
+{
+  size_t max_ops = n > config->ops ? n : config->ops;
+  bench_result_t result = { 0 };
+  perf_reset(&result);
+  result._batch_ns = (double*)malloc((max_ops / BENCH_BATCH + 1) * sizeof(double));
+  swiss_table_t* tbl = swiss_table_init_ex(backend);
+  if (!result._batch_ns || !tbl) {
+    fprintf(stderr, "out of memory at size %zu\n", n);
+    free(result._batch_ns);
+    swiss_table_destroy(tbl);
+    return;
+  }
+  backend = swiss_table_get_backend(tbl);
+  run_insert(tbl, n, long_keys, &result);
+  report(config, swiss_table_backend_name(backend), "insert", n, long_keys, "seq", 0, "0/100/0", &result);
+  for (size_t index = 0; index < sizeof(workloads) / sizeof(workloads[0]); ++index) {
+    const workload_t* workload = &workloads[index];
+    char mix[16];
+    snprintf(mix, sizeof(mix), "%u/%u/%u", 100u - workload->_write_pct - workload->_delete_pct, workload->_write_pct, workload->_delete_pct);
+    run_workload(tbl, workload, n, config->ops, long_keys, rng, &result);
+    report(config, swiss_table_backend_name(backend), workload->_name, n, long_keys, workload->_dist == DIST_ZIPF ? "zipf" : "uniform", workload->_hit_ratio, mix, &result);
+  }
+  swiss_table_destroy(tbl);
+  free(result._batch_ns);
+}
+
+static void
+run_concurrent_phase(swiss_table_concurrent_t* tbl, uint32_t threads, size_t n, size_t ops, uint8_t mixed, uint8_t long_keys, uint64_t seed, bench_result_t* result)
+{
+  size_t batches = 0;
+  uint64_t start = now_ns();
+  #pragma omp parallel num_threads(threads)
+  {
+    size_t thread = (size_t)omp_get_thread_num();
+    size_t team = (size_t)omp_get_num_threads();
+    char keys[BENCH_BATCH][KEY_SIZE];
+    size_t lens[BENCH_BATCH];
+    uint8_t kinds[BENCH_BATCH];
+    char buf[KEY_SIZE];
+    uint64_t rng = seed ^ (thread + 1) * 0xbf58476d1ce4e5b9ull;
+    size_t sink = 0;
+    for (size_t done = ops * thread / team, last = ops * (thread + 1) / team; done < last; done += BENCH_BATCH) {
+      size_t count = last - done < BENCH_BATCH ? last - done : BENCH_BATCH;
+      for (size_t op = 0; op < count; ++op) {
+        uint64_t roll = rng_next(&rng) % 100;
+        kinds[op] = !mixed ? OP_INSERT : roll < 1 ? OP_DELETE : roll < 10 ? OP_INSERT : OP_GET;
+        lens[op] = format_key(keys[op], mixed ? rng_next(&rng) % (2 * (uint64_t)n) : done + op, long_keys);
+      }
+      uint64_t batch_start = now_ns();
+      for (size_t op = 0; op < count; ++op) {
+        switch (kinds[op]) {
+          case OP_GET:
+            sink += swiss_table_concurrent_get_into_n(tbl, keys[op], lens[op], buf, sizeof(buf), NULL);
+            break;
+          case OP_INSERT:
+            sink += swiss_table_concurrent_insert_update_n(tbl, keys[op], lens[op], keys[op], lens[op]);
+            break;
+          default:
+            sink += swiss_table_concurrent_delete_n(tbl, keys[op], lens[op]);
+            break;
+        }
+      }
+      uint64_t elapsed = now_ns() - batch_start;
+      /* Each thread ends on at most one short batch, so the slots suffice. */
+      result->_batch_ns[__atomic_fetch_add(&batches, 1, __ATOMIC_RELAXED)] = (double)elapsed / count;
+    }
+    __atomic_fetch_add(&bench_sink, sink, __ATOMIC_RELAXED);
+  }
+  result->_seconds += (now_ns() - start) * 1e-9;
+  result->_ops += ops;
+  result->_batches += batches;
+}
+
+static void
+run_concurrent(const bench_config_t* config, size_t n, uint8_t long_keys, uint64_t seed)
+{
+  size_t max_ops = n > config->ops ? n : config->ops;
+  bench_result_t result = { 0 };
+  perf_reset(&result);
+  result._batch_ns = (double*)malloc((max_ops / BENCH_BATCH + config->threads) * sizeof(double));
+  swiss_table_concurrent_t* tbl = swiss_table_concurrent_init();
+  if (!result._batch_ns || !tbl) {
+    fprintf(stderr, "out of memory at size %zu\n", n);
+    free(result._batch_ns);
+    swiss_table_concurrent_destroy(tbl);
+    return;
+  }
+  char name[16];
+  snprintf(name, sizeof(name), "conc/%u", config->threads);
+  run_concurrent_phase(tbl, config->threads, n, n, 0, long_keys, seed, &result);
+  report(config, name, "insert", n, long_keys, "seq", 0, "0/100/0", &result);
+  run_concurrent_phase(tbl, config->threads, n, config->ops, 1, long_keys, seed, &result);
+  report(config, name, "mixed", n, long_keys, "uniform", 0.5, "90/9/1", &result);
+  swiss_table_concurrent_destroy(tbl);
+  free(result._batch_ns);
+}
+
+static size_t
+parse_sizes(const char* arg, size_t* sizes, size_t cap)
+{
+  size_t count = 0;
+  for (char* end; *arg && count < cap; arg = *end ? end + 1 : end) {
+    sizes[count] = strtoull(arg, &end, 10);
+    if (end == arg || !sizes[count]) {
+      return 0;
+    }
+    ++count;
+  }
+  return count;
+}
+
+int
+main(int argc, char** argv)
+{
+  bench_config_t config = { { 1000, 100000, 1000000 }, 3, 1000000, KEYS_SHORT | KEYS_LONG, 1u << SWISS_TABLE_BACKEND_AUTO, 0, 0, 0, 42 };
+  for (int arg = 1; arg < argc; ++arg) {
+    if (!strcmp(argv[arg], "--csv")) {
+      config.csv = 1;
+    } else if (!strcmp(argv[arg], "--sizes") && arg + 1 < argc) {
+      config.size_count = parse_sizes(argv[++arg], config.sizes, sizeof(config.sizes) / sizeof(config.sizes[0]));
+    } else if (!strcmp(argv[arg], "--ops") && arg + 1 < argc) {
+      config.ops = strtoull(argv[++arg], NULL, 10);
+    } else if (!strcmp(argv[arg], "--perf")) {
+      config.perf = 1;
+    } else if (!strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+      config.threads = (uint32_t)strtoul(argv[++arg], NULL, 10);
+    } else if (!strcmp(argv[arg], "--seed") && arg + 1 < argc) {
+      config.seed = strtoull(argv[++arg], NULL, 10);
+    } else if (!strcmp(argv[arg], "--keys") && arg + 1 < argc) {
+      const char* keys = argv[++arg];
+      config.keys = (strstr(keys, "short") ? KEYS_SHORT : 0) | (strstr(keys, "long") ? KEYS_LONG : 0);
+    } else if (!strcmp(argv[arg], "--backends") && arg + 1 < argc) {
+      const char* backends = argv[++arg];
+      config.backends = 0;
+      for (uint8_t backend = SWISS_TABLE_BACKEND_CONS; backend <= SWISS_TABLE_BACKEND_PARALLEL; ++backend) {
+        config.backends |= strstr(backends, swiss_table_backend_name(backend)) ? 1u << backend : 0;
+      }
+    } else {
+      config.size_count = 0;
+      break;
+    }
+  }
+  if (!config.size_count || !config.ops || !config.keys || !config.backends) {
+    fprintf(stderr, "usage: %s [--sizes N,N,...] [--ops N] [--keys short,long] [--backends cons,simd,parallel] [--threads N] [--seed N] [--perf] [--csv]\n", argv[0]);
+    return 1;
+  }
+  if (config.perf && perf_open(&bench_perf) < PERF_EVENT_COUNT) {
+    int error = errno;
+    if (!bench_perf._open) {
+      fprintf(stderr, "perf counters unavailable (%s), reporting time only\n", strerror(error));
+      config.perf = 0;
+    } else {
+      fprintf(stderr, "some perf counters unavailable (%s), reported as missing\n", strerror(error));
+    }
+  }
+  if (config.csv) {
+    printf("backend,workload,size,keys,dist,hit_ratio,mix,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns%s\n",
+           config.perf ? ",ipc,instructions_per_op,l1d_misses_per_op,llc_misses_per_op,dtlb_misses_per_op,branch_misses_per_op" : "");
+  }
+  for (uint8_t backend = SWISS_TABLE_BACKEND_AUTO; backend <= SWISS_TABLE_BACKEND_PARALLEL; ++backend) {
+    if (!(config.backends & (1u << backend))) {
+      continue;
+    }
+    /* Every backend sees the same key stream. */
+    uint64_t rng = config.seed;
+    for (size_t index = 0; index < config.size_count; ++index) {
+      for (uint8_t long_keys = 0; long_keys < 2; ++long_keys) {
+        if (config.keys & (long_keys ? KEYS_LONG : KEYS_SHORT)) {
+          run_size(&config, backend, config.sizes[index], long_keys, &rng);
+        }
+      }
+    }
+  }
+  if (config.threads) {
+    for (size_t index = 0; index < config.size_count; ++index) {
+      for (uint8_t long_keys = 0; long_keys < 2; ++long_keys) {
+        if (config.keys & (long_keys ? KEYS_LONG : KEYS_SHORT)) {
+          run_concurrent(&config, config.sizes[index], long_keys, config.seed);
+        }
+      }
+    }
+  }
+  perf_close(&bench_perf);
+  return 0;
+}
@@ -1,32 +1,17 @@
-#include "../swiss_table.h"
+#include "../swiss_table_internal.h"
+#include "../swiss_table_concurrent.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <omp.h>
 
-#define GROUP_SIZE 16
-#define INITIAL_GROUP_COUNT 16
-#define MAX_FILL 0.7f
-
-#define DELETED 0xfe
-#define EMPTY 0x80
-
-#define METADATA_MASK 0x7e
-#define HASH_MASK 0xffffffffffffff80
-
-struct swiss_table_node
-{
-  char* _key;
-  char* _data;
-};
-
-struct swiss_table 
-{
-  uint8_t** _control;
-  node_t** _groups;
-  uint32_t _group_count;
-  uint32_t _current_size;
-  uint32_t _deleted;
-  uint64_t (*hash_f)(const char*);
-};
+#define PARTITIONS_PER_THREAD 8
 
+/*
+ * OpenMP backend: groups are matched with omp simd loops, and rehashing
+ * and bulk builds place entries on all OpenMP threads (place_all). The
+ * sharded concurrent table lives here as well.
+ */
 static inline void
 find_metadata(int8_t* res, const uint8_t* data, const uint8_t meta)
 {
@@ -36,246 +21,768 @@ find_metadata(int8_t* res, const uint8_t* data, const uint8_t meta)
   }
 }
 
-static uint64_t
-hash(const char* key)
+static uint32_t
+find(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h)
 {
-  static const uint16_t noise[] = { 18894, 1149, 9843, 5236, 21354, 26871, 21465, 17861, 2414, 5219, 24185, 5711, 866, 16758, 26915, 27184 };
-  uint64_t sum = 0, hash = 0;
-  for (uint32_t i = 0; i < strlen(key); ++i) {
-    sum += (key[i] * noise[i % 16]);
-  }
-  for (uint8_t i = 0; i < 8; ++i) {
-    hash ^= ((sum << i) | (sum >> (64 - i)));
-  }
-  return hash;
-}
-
-static void
-expand(swiss_table_t* tbl_ptr)
-{
-  tbl_ptr->_group_count *= 2;
-  tbl_ptr->_current_size = 0;
-  tbl_ptr->_deleted = 0;
-  node_t** tmp_groups = tbl_ptr->_groups;
-  uint8_t** tmp_control = tbl_ptr->_control;
-  tbl_ptr->_groups = (node_t**)malloc(tbl_ptr->_group_count * sizeof(node_t*));
-  tbl_ptr->_control = (uint8_t**)malloc(tbl_ptr->_group_count * sizeof(uint8_t*)); 
-  #pragma omp parallel for
-  for (uint32_t i = 0; i < tbl_ptr->_group_count; ++i) {
-    tbl_ptr->_control[i] = (uint8_t*)malloc(GROUP_SIZE * sizeof(uint8_t));
-    memset(tbl_ptr->_control[i], EMPTY, GROUP_SIZE);
-    tbl_ptr->_groups[i] = (node_t*)calloc(GROUP_SIZE, sizeof(node_t));
-  }
-  for (uint32_t group_index = 0; group_index < tbl_ptr->_group_count / 2; ++group_index) {
-    for (uint8_t node_index = 0; node_index < GROUP_SIZE; ++node_index) {
-      if ((int8_t)tmp_control[group_index][node_index] >= 0) {
-        swiss_table_insert_update(tbl_ptr, tmp_groups[group_index][node_index]._key, tmp_groups[group_index][node_index]._data);
-        free(tmp_groups[group_index][node_index]._key);
-        free(tmp_groups[group_index][node_index]._data);
+  uint8_t metadata = h & METADATA_MASK;
+  for (uint32_t pos = probe_start(tbl_ptr, h), step = GROUP_SIZE;;pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    const uint8_t* control = tbl_ptr->_control + pos;
+    int8_t meta_match[GROUP_SIZE];
+    int8_t meta_empty[GROUP_SIZE];
+    find_metadata(meta_match, control, metadata);
+    find_metadata(meta_empty, control, EMPTY);
+    uint8_t match_index = GROUP_SIZE, empty_index = GROUP_SIZE;
+    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
+      if (match_index == GROUP_SIZE && meta_match[metadata_index]) {
+        if (STATS_TAG(tbl_ptr, node_has_key(&tbl_ptr->_slots[(pos + metadata_index) & slot_mask(tbl_ptr)], key, key_len, h))) {
+          match_index = metadata_index;
+        }
+      }
+      if (empty_index == GROUP_SIZE && meta_empty[metadata_index]) {
+        empty_index = metadata_index;
       }
     }
-    free(tmp_groups[group_index]);
-    free(tmp_control[group_index]);
-  }
-  free(tmp_groups);
-  free(tmp_control);
-}
-
-swiss_table_t*
-swiss_table_init(void)
-{
-  swiss_table_t* new_table = (swiss_table_t*)calloc(1, sizeof(swiss_table_t));
-  new_table->_group_count = INITIAL_GROUP_COUNT;
-  new_table->hash_f = &hash;
-  new_table->_control = (uint8_t**)malloc(INITIAL_GROUP_COUNT * sizeof(uint8_t*));
-  new_table->_groups = (node_t**)malloc(INITIAL_GROUP_COUNT * sizeof(node_t*));
-  for (uint8_t i = 0; i < INITIAL_GROUP_COUNT; ++i) {
-    new_table->_control[i] = (uint8_t*)malloc(GROUP_SIZE * sizeof(uint8_t));
-    memset(new_table->_control[i], EMPTY, GROUP_SIZE);
-    new_table->_groups[i] = (node_t*)calloc(GROUP_SIZE, sizeof(node_t));
-  }
-  return new_table;
-}
-
-inline void
-swiss_table_set_hash(swiss_table_t* tbl_ptr, uint64_t (*hash_f)(const char*))
-{
-  if (!tbl_ptr || !hash_f) {
-    return;
+    if (match_index < GROUP_SIZE) {
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return (pos + match_index) & slot_mask(tbl_ptr);
+    }
+    if (empty_index < GROUP_SIZE) {
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return UINT32_MAX;
+    }
   }
-  tbl_ptr->hash_f = hash_f;
 }
 
-uint8_t
-swiss_table_insert_update(swiss_table_t* tbl_ptr, const char* key, const char* data)
+static uint32_t
+find_slot(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h, uint8_t* found)
 {
-  if (!tbl_ptr || !key || !data) {
-    return INVALID_ARGS;
-  }
-  if (tbl_ptr->_current_size > tbl_ptr->_group_count * GROUP_SIZE * MAX_FILL) {
-    expand(tbl_ptr);
-  }
-  uint64_t h = tbl_ptr->hash_f(key);
   uint8_t metadata = h & METADATA_MASK;
-  for (uint64_t group_index = ((h & HASH_MASK) >> 7) % tbl_ptr->_group_count;;group_index = (group_index + 1) % tbl_ptr->_group_count) {
+  uint32_t free_index = UINT32_MAX;
+  for (uint32_t pos = probe_start(tbl_ptr, h), step = GROUP_SIZE;;pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    const uint8_t* control = tbl_ptr->_control + pos;
     int8_t meta_match[GROUP_SIZE];
     int8_t meta_empty[GROUP_SIZE];
-    #pragma omp parallel sections
-    {
-      #pragma omp section
-      {
-        find_metadata(meta_match, tbl_ptr->_control[group_index], metadata);
-      }
-      #pragma omp section
-      {
-        find_metadata(meta_empty, tbl_ptr->_control[group_index], EMPTY);
-      }
-    }
+    find_metadata(meta_match, control, metadata);
+    find_metadata(meta_empty, control, EMPTY);
     uint8_t match_index = GROUP_SIZE, empty_index = GROUP_SIZE;
-    #pragma omp parallel for reduction(min:match_index) reduction(min:empty_index)
     for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta_match[metadata_index]) {
-        if (!strcmp(tbl_ptr->_groups[group_index][metadata_index]._key, key)) {
+      if (match_index == GROUP_SIZE && meta_match[metadata_index]) {
+        if (STATS_TAG(tbl_ptr, node_has_key(&tbl_ptr->_slots[(pos + metadata_index) & slot_mask(tbl_ptr)], key, key_len, h))) {
           match_index = metadata_index;
         }
       }
-      if (meta_empty[metadata_index]) {
+      if (empty_index == GROUP_SIZE && meta_empty[metadata_index]) {
         empty_index = metadata_index;
       }
     }
     if (match_index < GROUP_SIZE) {
-      free(tbl_ptr->_groups[group_index][match_index]._data);
-      tbl_ptr->_groups[group_index][match_index]._data = strdup(data);
-      return UPDATED;
+      *found = 1;
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return (pos + match_index) & slot_mask(tbl_ptr);
+    }
+    if (free_index == UINT32_MAX) {
+      for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
+        if (control[metadata_index] == EMPTY || control[metadata_index] == DELETED) {
+          free_index = (pos + metadata_index) & slot_mask(tbl_ptr);
+          break;
+        }
+      }
     }
     if (empty_index < GROUP_SIZE) {
-      tbl_ptr->_control[group_index][empty_index] = metadata;
-      tbl_ptr->_groups[group_index][empty_index]._key = strdup( key);
-      tbl_ptr->_groups[group_index][empty_index]._data = strdup( data);
-      ++tbl_ptr->_current_size;
-      return NO_ERR;
+      *found = 0;
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return free_index;
     }
   }
 }
 
-uint8_t
-swiss_table_delete(swiss_table_t* tbl_ptr, const char* key)
+static uint32_t
+find_free_slot(const swiss_table_t* tbl_ptr, uint64_t h)
 {
-  if (!tbl_ptr || !key) {
-    return INVALID_ARGS;
+  for (uint32_t pos = probe_start(tbl_ptr, h), step = GROUP_SIZE;;pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    const uint8_t* control = tbl_ptr->_control + pos;
+    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
+      if (control[metadata_index] == EMPTY || control[metadata_index] == DELETED) {
+        return (pos + metadata_index) & slot_mask(tbl_ptr);
+      }
+    }
   }
-  uint64_t h = tbl_ptr->hash_f(key);
+}
+
+static uint32_t
+find_match(const swiss_table_t* tbl_ptr, uint64_t h, uint32_t probe_limit, slot_match_f match, const void* ctx, uint32_t* free_slot)
+{
   uint8_t metadata = h & METADATA_MASK;
-  for (uint64_t group_index = ((h & HASH_MASK) >> 7) % tbl_ptr->_group_count;;group_index = (group_index + 1) % tbl_ptr->_group_count) {
+  uint32_t pos = probe_start(tbl_ptr, h);
+  if (free_slot) {
+    *free_slot = UINT32_MAX;
+  }
+  for (uint32_t probe = 0, step = GROUP_SIZE; probe < probe_limit; ++probe, pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    const uint8_t* control = tbl_ptr->_control + pos;
     int8_t meta_match[GROUP_SIZE];
     int8_t meta_empty[GROUP_SIZE];
-    #pragma omp parallel sections
-    {
-      #pragma omp section
-      {
-        find_metadata(meta_match, tbl_ptr->_control[group_index], metadata);
+    find_metadata(meta_match, control, metadata);
+    find_metadata(meta_empty, control, EMPTY);
+    uint8_t saw_empty = 0;
+    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
+      uint32_t index = (pos + metadata_index) & slot_mask(tbl_ptr);
+      if (meta_match[metadata_index] && STATS_TAG(tbl_ptr, match(ctx, index))) {
+        STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+        return index;
       }
-      #pragma omp section
-      {
-        find_metadata(meta_empty, tbl_ptr->_control[group_index], EMPTY);
+      saw_empty |= meta_empty[metadata_index];
+    }
+    for (uint8_t metadata_index = 0; free_slot && *free_slot == UINT32_MAX && metadata_index < GROUP_SIZE; ++metadata_index) {
+      if (control[metadata_index] == EMPTY || control[metadata_index] == DELETED) {
+        *free_slot = (pos + metadata_index) & slot_mask(tbl_ptr);
       }
     }
-    uint8_t match_index = GROUP_SIZE, empty_index = GROUP_SIZE, empty_flag = 0;
-    #pragma omp parallel for reduction(min:match_index) reduction(min:empty_index)
+    if (saw_empty) {
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return UINT32_MAX;
+    }
+  }
+  STATS_PROBE(tbl_ptr, probe_limit);
+  return UINT32_MAX;
+}
+
+static uint8_t
+was_never_full(const swiss_table_t* tbl_ptr, uint32_t index)
+{
+  const uint8_t* after = tbl_ptr->_control + index;
+  const uint8_t* before = tbl_ptr->_control + ((index - GROUP_SIZE) & slot_mask(tbl_ptr));
+  uint8_t full_after = 0, full_before = 0;
+  while (full_after < GROUP_SIZE && after[full_after] != EMPTY) {
+    ++full_after;
+  }
+  while (full_before < GROUP_SIZE && before[GROUP_SIZE - 1 - full_before] != EMPTY) {
+    ++full_before;
+  }
+  return full_after < GROUP_SIZE && full_before < GROUP_SIZE && full_after + full_before < GROUP_SIZE;
+}
+
+static uint32_t
+next_full(const uint8_t* control, uint32_t capacity, uint32_t index)
+{
+  while (index < capacity && (int8_t)control[index] < 0) {
+    ++index;
+  }
+  return index;
+}
+
+/*
+ * Places node along its probe sequence without locking. Returns 0 without
+ * writing if the slot it needs lies outside [lo, hi), which another
+ * thread owns; 1 if it was placed; 2 if dedup found its key already
+ * placed, in which case the higher source index, carried in _data while
+ * building, is kept.
+ */
+static uint8_t
+place_in_range(swiss_table_t* tbl_ptr, const node_t* node, uint32_t lo, uint32_t hi, uint8_t dedup)
+{
+  uint8_t metadata = node->_hash & METADATA_MASK;
+  for (uint32_t pos = probe_start(tbl_ptr, node->_hash), step = GROUP_SIZE;;pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
     for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta_match[metadata_index]) {
-        if (!strcmp(tbl_ptr->_groups[group_index][metadata_index]._key, key)) {
-          for (uint8_t m = 0; m < GROUP_SIZE; ++m) {
-            if (meta_empty[m]) {
-              #pragma omp atomic write
-              empty_flag = 1;
-            }
-          }
-          match_index = metadata_index;
+      uint32_t index = (pos + metadata_index) & slot_mask(tbl_ptr);
+      uint8_t control = __atomic_load_n(&tbl_ptr->_control[index], __ATOMIC_ACQUIRE);
+      if (control == EMPTY) {
+        if (index < lo || index >= hi) {
+          return 0;
         }
+        tbl_ptr->_slots[index] = *node;
+        __atomic_store_n(&tbl_ptr->_control[index], metadata, __ATOMIC_RELEASE);
+        return 1;
       }
-      if (meta_empty[metadata_index]) {
-        empty_index = metadata_index;
+      if (dedup && control == metadata && node_has_key(&tbl_ptr->_slots[index], node_key(node), node->_key_len, node->_hash)) {
+        if (index < lo || index >= hi) {
+          return 0;
+        }
+        if ((uintptr_t)tbl_ptr->_slots[index]._data < (uintptr_t)node->_data) {
+          tbl_ptr->_slots[index]._data = node->_data;
+          tbl_ptr->_slots[index]._data_len = node->_data_len;
+        }
+        return 2;
       }
     }
-    if (match_index < GROUP_SIZE) {
-      free(tbl_ptr->_groups[group_index][match_index]._key);
-      free(tbl_ptr->_groups[group_index][match_index]._data);
-      if (empty_flag) {
-        tbl_ptr->_control[group_index][match_index] = EMPTY;
-        --tbl_ptr->_current_size;
-        return NO_ERR;
+  }
+}
+
+/*
+ * Places count nodes (those with a full byte in full, if given) into the
+ * table's freshly allocated arrays and returns how many entries were
+ * added. Large inputs are counting-sorted by the partition their probe
+ * starts in (the top bits of H1) and the partitions are filled in
+ * parallel, each thread writing only its own partition's slots. Slots
+ * only go from EMPTY to full here, so a foreign window seen without an
+ * EMPTY slot stays that way; nodes whose slot would be in a neighbouring
+ * partition are placed serially afterwards.
+ */
+static size_t
+place_all(swiss_table_t* tbl_ptr, const node_t* nodes, const uint8_t* full, size_t count, uint8_t dedup)
+{
+  size_t placed = 0;
+  uint32_t threads = omp_get_max_threads();
+  uint32_t partitions = 1;
+  while (partitions < threads * PARTITIONS_PER_THREAD && partitions < tbl_ptr->_group_count) {
+    partitions *= 2;
+  }
+  uint32_t* order = NULL;
+  size_t* offsets = NULL;
+  if (count >= PARALLEL_MIN_ENTRIES && threads > 1 && partitions > 1) {
+    order = (uint32_t*)tbl_alloc(tbl_ptr, count * sizeof(uint32_t), _Alignof(uint32_t));
+    offsets = (size_t*)tbl_alloc(tbl_ptr, (size_t)partitions * threads * sizeof(size_t), _Alignof(size_t));
+  }
+  if (!order || !offsets) {
+    tbl_free(tbl_ptr, order, count * sizeof(uint32_t));
+    tbl_free(tbl_ptr, offsets, (size_t)partitions * threads * sizeof(size_t));
+    for (size_t index = 0; index < count; ++index) {
+      if (!full || (int8_t)full[index] >= 0) {
+        placed += place_in_range(tbl_ptr, &nodes[index], 0, capacity(tbl_ptr), dedup) == 1;
       }
-      tbl_ptr->_control[group_index][match_index] = DELETED;
-      ++tbl_ptr->_deleted;
-      return NO_ERR;
     }
-    if (empty_index < GROUP_SIZE) {
-      return KEY_NOT_FOUND;
+    memcpy(tbl_ptr->_control + capacity(tbl_ptr), tbl_ptr->_control, GROUP_SIZE);
+    return placed;
+  }
+  memset(offsets, 0, (size_t)partitions * threads * sizeof(size_t));
+  uint32_t partition_size = capacity(tbl_ptr) / partitions;
+  size_t total = 0;
+  #pragma omp parallel num_threads(threads) reduction(+:placed)
+  {
+    uint32_t thread = omp_get_thread_num(), team = omp_get_num_threads();
+    size_t first = count * thread / team, last = count * (thread + 1) / team;
+    for (size_t index = first; index < last; ++index) {
+      if (!full || (int8_t)full[index] >= 0) {
+        ++offsets[probe_start(tbl_ptr, nodes[index]._hash) / partition_size * threads + thread];
+      }
+    }
+    #pragma omp barrier
+    #pragma omp single
+    {
+      for (size_t index = 0; index < (size_t)partitions * threads; ++index) {
+        size_t block = offsets[index];
+        offsets[index] = total;
+        total += block;
+      }
+    }
+    for (size_t index = first; index < last; ++index) {
+      if (!full || (int8_t)full[index] >= 0) {
+        order[offsets[probe_start(tbl_ptr, nodes[index]._hash) / partition_size * threads + thread]++] = index;
+      }
+    }
+    #pragma omp barrier
+    #pragma omp for schedule(dynamic)
+    for (uint32_t partition = 0; partition < partitions; ++partition) {
+      uint32_t lo = partition * partition_size;
+      size_t begin = partition ? offsets[partition * threads - 1] : 0;
+      for (size_t index = begin; index < offsets[partition * threads + threads - 1]; ++index) {
+        uint8_t res = place_in_range(tbl_ptr, &nodes[order[index]], lo, lo + partition_size, dedup);
+        if (res) {
+          placed += res == 1;
+          order[index] = UINT32_MAX;
+        }
+      }
+    }
+  }
+  for (size_t index = 0; index < total; ++index) {
+    if (order[index] != UINT32_MAX) {
+      placed += place_in_range(tbl_ptr, &nodes[order[index]], 0, capacity(tbl_ptr), dedup) == 1;
     }
   }
+  memcpy(tbl_ptr->_control + capacity(tbl_ptr), tbl_ptr->_control, GROUP_SIZE);
+  tbl_free(tbl_ptr, order, count * sizeof(uint32_t));
+  tbl_free(tbl_ptr, offsets, (size_t)partitions * threads * sizeof(size_t));
+  return placed;
 }
 
-char*
-swiss_table_get_copy(const swiss_table_t* tbl_ptr, const char* key)
+
+const swiss_table_backend_t swiss_table_backend_parallel = {
+  "parallel", SWISS_TABLE_BACKEND_PARALLEL,
+  &find, &find_slot, &find_free_slot, &find_match, &was_never_full, &next_full,
+  &place_all
+};
+
+#define SHARD_DEFAULT_COUNT 64
+#define SHARD_MAX_COUNT (1u << 16)
+/* Above every bit H1 can use at the largest capacity. */
+#define SHARD_HASH_SHIFT 40
+#define READ_SPINS 64
+
+/*
+ * Writers serialise on _lock and keep _version odd while they mutate the
+ * table (seqlock); readers take no lock and retry when the version moved.
+ */
+typedef struct shard
 {
-  if (!tbl_ptr || !key) {
-    return NULL;
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t _version;
+  pthread_mutex_t _lock;
+  swiss_table_t* _table;
+  reclaim_t _reclaim;
+} shard_t;
+
+struct swiss_table_concurrent
+{
+  epoch_domain_t _domain;
+  shard_t* _shards;
+  uint32_t _shard_count;
+  swiss_table_allocator_t _allocator;
+};
+
+static inline shard_t*
+shard_for(const swiss_table_concurrent_t* tbl_ptr, uint64_t h)
+{
+  return &tbl_ptr->_shards[(h >> SHARD_HASH_SHIFT) & (tbl_ptr->_shard_count - 1)];
+}
+
+/* Every shard shares the seed and hash functions of shard 0. */
+static inline const swiss_table_t*
+hash_source(const swiss_table_concurrent_t* tbl_ptr)
+{
+  return tbl_ptr->_shards[0]._table;
+}
+
+/*
+ * The version bump and a reader's epoch_enter form a store-then-load
+ * handshake on two locations, which release/acquire does not order: the
+ * seq_cst fence here pairs with the one in epoch_enter, so either the
+ * reader sees the odd version and retries, or reclaim_collect (which runs
+ * after this fence) sees the reader's epoch slot and keeps what it may
+ * still reach.
+ */
+static inline void
+write_begin(shard_t* shard)
+{
+  pthread_mutex_lock(&shard->_lock);
+  atomic_store_explicit(&shard->_version, atomic_load_explicit(&shard->_version, memory_order_relaxed) + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+static inline void
+write_end(shard_t* shard)
+{
+  atomic_store_explicit(&shard->_version, atomic_load_explicit(&shard->_version, memory_order_relaxed) + 1, memory_order_release);
+  pthread_mutex_unlock(&shard->_lock);
+}
+
+static inline uint8_t
+read_valid(shard_t* shard, uint32_t version)
+{
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(&shard->_version, memory_order_relaxed) == version;
+}
+
+static reader_slot_t*
+epoch_enter(epoch_domain_t* domain)
+{
+  static _Atomic uint32_t next_hint;
+  static _Thread_local uint32_t hint = UINT32_MAX;
+  if (hint == UINT32_MAX) {
+    hint = atomic_fetch_add(&next_hint, 1);
+  }
+  uint64_t epoch = atomic_load(&domain->_epoch);
+  for (uint32_t index = hint;; ++index) {
+    reader_slot_t* slot = &domain->_readers[index % READER_SLOTS];
+    uint64_t idle = 0;
+    if (atomic_compare_exchange_strong(&slot->_epoch, &idle, epoch)) {
+      /* Orders the slot store before the version load; see write_begin. */
+      atomic_thread_fence(memory_order_seq_cst);
+      return slot;
+    }
+    /* Every slot is taken: let a reader finish rather than spin on them. */
+    if ((index - hint) % READER_SLOTS == READER_SLOTS - 1) {
+      sched_yield();
+    }
   }
-  uint64_t h = tbl_ptr->hash_f(key);
+}
+
+static inline void
+epoch_exit(reader_slot_t* slot)
+{
+  atomic_store_explicit(&slot->_epoch, 0, memory_order_release);
+}
+
+/*
+ * Copies a node a writer may be changing. Every field is read with a
+ * relaxed atomic load, so the copy is a race-free snapshot that
+ * read_valid then confirms or rejects.
+ */
+static inline void
+load_node(const node_t* node, node_t* copy)
+{
+  for (uint32_t word = 0; word < INLINE_KEY_SIZE / sizeof(uint64_t); ++word) {
+    copy->_key._words[word] = __atomic_load_n(&node->_key._words[word], __ATOMIC_RELAXED);
+  }
+  copy->_data = __atomic_load_n(&node->_data, __ATOMIC_RELAXED);
+  copy->_key_len = __atomic_load_n(&node->_key_len, __ATOMIC_RELAXED);
+  copy->_data_len = __atomic_load_n(&node->_data_len, __ATOMIC_RELAXED);
+  copy->_hash = __atomic_load_n(&node->_hash, __ATOMIC_RELAXED);
+}
+
+/*
+ * One lock-free lookup against a single version of the shard. Nodes are
+ * copied and validated before their key is compared, so the pointers in
+ * *found belong to one consistent entry; the epoch keeps them allocated.
+ * Returns 1 if found, 0 if absent, -1 if a writer interfered.
+ */
+static int
+optimistic_find(shard_t* shard, const char* key, size_t key_len, uint64_t h, node_t* found)
+{
+  uint32_t version = atomic_load_explicit(&shard->_version, memory_order_acquire);
+  if (version & 1) {
+    return -1;
+  }
+  const swiss_table_t* tbl_ptr = shard->_table;
+  const uint8_t* control = __atomic_load_n(&tbl_ptr->_control, __ATOMIC_RELAXED);
+  const node_t* slots = __atomic_load_n(&tbl_ptr->_slots, __ATOMIC_RELAXED);
+  uint32_t group_count = __atomic_load_n(&tbl_ptr->_group_count, __ATOMIC_RELAXED);
+  if (!read_valid(shard, version)) {
+    return -1;
+  }
+  uint32_t mask = group_count * GROUP_SIZE - 1;
   uint8_t metadata = h & METADATA_MASK;
-  for (uint64_t group_index = ((h & HASH_MASK) >> 7) % tbl_ptr->_group_count;;group_index = (group_index + 1) % tbl_ptr->_group_count) {
+  uint32_t pos = (h >> METADATA_BITS) & mask;
+  for (uint32_t probe = 0, step = GROUP_SIZE; probe < group_count; ++probe, pos = (pos + step) & mask, step += GROUP_SIZE) {
+    uint8_t group[GROUP_SIZE];
     int8_t meta_match[GROUP_SIZE];
     int8_t meta_empty[GROUP_SIZE];
-    #pragma omp parallel sections
-    {
-      #pragma omp section
-      {
-        find_metadata(meta_match, tbl_ptr->_control[group_index], metadata);
-      }
-      #pragma omp section
-      {
-        find_metadata(meta_empty, tbl_ptr->_control[group_index], EMPTY);
-      }
+    for (uint8_t index = 0; index < GROUP_SIZE; ++index) {
+      group[index] = __atomic_load_n(&control[pos + index], __ATOMIC_RELAXED);
     }
-    uint8_t match_index = GROUP_SIZE, empty_index = GROUP_SIZE;
-    #pragma omp parallel for reduction(min:match_index) reduction(min:empty_index)
+    find_metadata(meta_match, group, metadata);
+    find_metadata(meta_empty, group, EMPTY);
+    uint8_t saw_empty = 0;
     for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
       if (meta_match[metadata_index]) {
-        if (!strcmp(tbl_ptr->_groups[group_index][metadata_index]._key, key)) {
-          match_index = metadata_index;
+        node_t node;
+        load_node(&slots[(pos + metadata_index) & mask], &node);
+        if (!read_valid(shard, version)) {
+          return -1;
+        }
+        if (node_has_key(&node, key, key_len, h)) {
+          *found = node;
+          return 1;
         }
       }
-      if (meta_empty[metadata_index]) {
-        empty_index = metadata_index;
-      }
+      saw_empty |= meta_empty[metadata_index];
     }
-    if (match_index < GROUP_SIZE) {
-      return strdup(tbl_ptr->_groups[group_index][match_index]._data);
+    if (saw_empty) {
+      return read_valid(shard, version) ? 0 : -1;
     }
-    if (empty_index < GROUP_SIZE) {
+  }
+  return -1;
+}
+
+/* Looks key up without locking; call between epoch_enter and epoch_exit. */
+static uint8_t
+optimistic_get(shard_t* shard, const char* key, size_t key_len, uint64_t h, node_t* found)
+{
+  int res;
+  for (uint32_t spins = 0; (res = optimistic_find(shard, key, key_len, h, found)) < 0; ++spins) {
+    if (spins >= READ_SPINS) {
+      sched_yield();
+    }
+  }
+  return res;
+}
+
+static void
+destroy_shard(shard_t* shard)
+{
+  swiss_table_reclaim_release(shard->_table);
+  pthread_mutex_destroy(&shard->_lock);
+  swiss_table_destroy(shard->_table);
+}
+
+static void
+free_shards(swiss_table_concurrent_t* tbl_ptr, uint32_t shard_count)
+{
+  for (uint32_t index = 0; index < shard_count; ++index) {
+    destroy_shard(&tbl_ptr->_shards[index]);
+  }
+  swiss_table_allocator_t allocator = tbl_ptr->_allocator;
+  allocator.free(allocator.ctx, tbl_ptr->_shards, (size_t)tbl_ptr->_shard_count * sizeof(shard_t));
+  allocator.free(allocator.ctx, tbl_ptr, sizeof(swiss_table_concurrent_t));
+}
+
+swiss_table_concurrent_t*
+swiss_table_concurrent_init(void)
+{
+  return swiss_table_concurrent_init_opts(NULL, 0);
+}
+
+swiss_table_concurrent_t*
+swiss_table_concurrent_init_opts(const swiss_table_options_t* opts, uint32_t shard_count)
+{
+  if (shard_count > SHARD_MAX_COUNT) {
+    return NULL;
+  }
+  uint32_t count = 1;
+  while (count < (shard_count ? shard_count : SHARD_DEFAULT_COUNT)) {
+    count *= 2;
+  }
+  swiss_table_options_t shard_opts = { 0 };
+  if (opts) {
+    shard_opts = *opts;
+  }
+  if (!shard_opts.allocator.alloc || !shard_opts.allocator.free) {
+    shard_opts.allocator.alloc = &swiss_table_default_alloc;
+    shard_opts.allocator.free = &swiss_table_default_free;
+  }
+  shard_opts.capacity = (shard_opts.capacity + count - 1) / count;
+  /* Lock-free readers only probe the current arrays. */
+  shard_opts.incremental_resize = 0;
+  swiss_table_allocator_t allocator = shard_opts.allocator;
+  swiss_table_concurrent_t* new_table = (swiss_table_concurrent_t*)allocator.alloc(allocator.ctx, sizeof(swiss_table_concurrent_t), _Alignof(swiss_table_concurrent_t));
+  if (!new_table) {
+    return NULL;
+  }
+  memset(new_table, 0, sizeof(swiss_table_concurrent_t));
+  atomic_init(&new_table->_domain._epoch, 1);
+  new_table->_allocator = allocator;
+  new_table->_shard_count = count;
+  new_table->_shards = (shard_t*)allocator.alloc(allocator.ctx, (size_t)count * sizeof(shard_t), _Alignof(shard_t));
+  if (!new_table->_shards) {
+    allocator.free(allocator.ctx, new_table, sizeof(swiss_table_concurrent_t));
+    return NULL;
+  }
+  memset(new_table->_shards, 0, (size_t)count * sizeof(shard_t));
+  for (uint32_t index = 0; index < count; ++index) {
+    shard_t* shard = &new_table->_shards[index];
+    shard->_table = swiss_table_init_opts(&shard_opts);
+    if (!shard->_table) {
+      free_shards(new_table, index);
+      return NULL;
+    }
+    if (pthread_mutex_init(&shard->_lock, NULL)) {
+      swiss_table_destroy(shard->_table);
+      free_shards(new_table, index);
       return NULL;
     }
+    shard->_table->_seed = new_table->_shards[0]._table->_seed;
+    shard->_reclaim._domain = &new_table->_domain;
+    shard->_table->_reclaim = &shard->_reclaim;
   }
+  return new_table;
 }
 
 void
-swiss_table_destroy(swiss_table_t* tbl_ptr)
+swiss_table_concurrent_set_hash(swiss_table_concurrent_t* tbl_ptr, uint64_t (*hash_f)(const char*))
 {
   if (!tbl_ptr) {
     return;
   }
-  for (uint32_t i = 0; i < tbl_ptr->_group_count; ++i) {
-    for (uint8_t m = 0; m < GROUP_SIZE; ++m) {
-      if ((int8_t)(tbl_ptr->_control[i][m]) >= 0) {
-        free(tbl_ptr->_groups[i][m]._key);
-        free(tbl_ptr->_groups[i][m]._data);
-      }
+  for (uint32_t index = 0; index < tbl_ptr->_shard_count; ++index) {
+    swiss_table_set_hash(tbl_ptr->_shards[index]._table, hash_f);
+  }
+}
+
+void
+swiss_table_concurrent_set_hash_n(swiss_table_concurrent_t* tbl_ptr, uint64_t (*hash_n_f)(const char*, size_t))
+{
+  if (!tbl_ptr) {
+    return;
+  }
+  for (uint32_t index = 0; index < tbl_ptr->_shard_count; ++index) {
+    swiss_table_set_hash_n(tbl_ptr->_shards[index]._table, hash_n_f);
+  }
+}
+
+static uint8_t
+concurrent_insert_update(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len, uint64_t h)
+{
+  shard_t* shard = shard_for(tbl_ptr, h);
+  write_begin(shard);
+  uint8_t err = swiss_table_insert_hashed(shard->_table, key, key_len, data, data_len, h);
+  write_end(shard);
+  return err;
+}
+
+static uint8_t
+concurrent_erase(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, uint64_t h)
+{
+  shard_t* shard = shard_for(tbl_ptr, h);
+  write_begin(shard);
+  uint8_t err = swiss_table_erase_hashed(shard->_table, key, key_len, h);
+  write_end(shard);
+  return err;
+}
+
+/* NULL if absent or out of memory. */
+static char*
+concurrent_copy(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, size_t* data_len, uint64_t h)
+{
+  reader_slot_t* slot = epoch_enter(&tbl_ptr->_domain);
+  node_t node;
+  char* res = NULL;
+  if (optimistic_get(shard_for(tbl_ptr, h), key, key_len, h, &node)) {
+    if (data_len) {
+      *data_len = node._data_len;
     }
-    free(tbl_ptr->_control[i]);
-    free(tbl_ptr->_groups[i]);
+    res = dup_bytes(node._data, node._data_len);
+  }
+  epoch_exit(slot);
+  return res;
+}
+
+static uint8_t
+concurrent_copy_into(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, char* buf, size_t cap, size_t* data_len, uint64_t h)
+{
+  reader_slot_t* slot = epoch_enter(&tbl_ptr->_domain);
+  node_t node;
+  uint8_t found = optimistic_get(shard_for(tbl_ptr, h), key, key_len, h, &node);
+  uint8_t err = copy_into(found ? &node : NULL, buf, cap, data_len);
+  epoch_exit(slot);
+  return err;
+}
+
+uint8_t
+swiss_table_concurrent_insert_update(swiss_table_concurrent_t* tbl_ptr, const char* key, const char* data)
+{
+  if (!tbl_ptr || !key || !data) {
+    return INVALID_ARGS;
+  }
+  size_t key_len = strlen(key), data_len = strlen(data);
+  if (key_len > UINT32_MAX || data_len > UINT32_MAX) {
+    return INVALID_ARGS;
+  }
+  return concurrent_insert_update(tbl_ptr, key, key_len, data, data_len, key_hash(hash_source(tbl_ptr), key, key_len));
+}
+
+uint8_t
+swiss_table_concurrent_insert_update_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len)
+{
+  if (!tbl_ptr || !key || !data || key_len > UINT32_MAX || data_len > UINT32_MAX) {
+    return INVALID_ARGS;
+  }
+  uint64_t h;
+  if (!key_hash_n(hash_source(tbl_ptr), key, key_len, &h)) {
+    return OUT_OF_MEMORY;
+  }
+  return concurrent_insert_update(tbl_ptr, key, key_len, data, data_len, h);
+}
+
+uint8_t
+swiss_table_concurrent_delete(swiss_table_concurrent_t* tbl_ptr, const char* key)
+{
+  if (!tbl_ptr || !key) {
+    return INVALID_ARGS;
+  }
+  size_t key_len = strlen(key);
+  return concurrent_erase(tbl_ptr, key, key_len, key_hash(hash_source(tbl_ptr), key, key_len));
+}
+
+uint8_t
+swiss_table_concurrent_delete_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len)
+{
+  if (!tbl_ptr || !key) {
+    return INVALID_ARGS;
+  }
+  uint64_t h;
+  if (!key_hash_n(hash_source(tbl_ptr), key, key_len, &h)) {
+    return OUT_OF_MEMORY;
+  }
+  return concurrent_erase(tbl_ptr, key, key_len, h);
+}
+
+char*
+swiss_table_concurrent_get_copy(swiss_table_concurrent_t* tbl_ptr, const char* key)
+{
+  if (!tbl_ptr || !key) {
+    return NULL;
+  }
+  size_t key_len = strlen(key);
+  return concurrent_copy(tbl_ptr, key, key_len, NULL, key_hash(hash_source(tbl_ptr), key, key_len));
+}
+
+char*
+swiss_table_concurrent_get_copy_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, size_t* data_len)
+{
+  uint64_t h;
+  if (!tbl_ptr || !key || !key_hash_n(hash_source(tbl_ptr), key, key_len, &h)) {
+    return NULL;
+  }
+  return concurrent_copy(tbl_ptr, key, key_len, data_len, h);
+}
+
+uint8_t
+swiss_table_concurrent_get_into(swiss_table_concurrent_t* tbl_ptr, const char* key, char* buf, size_t cap, size_t* data_len)
+{
+  if (!tbl_ptr || !key || (!buf && cap)) {
+    return INVALID_ARGS;
+  }
+  size_t key_len = strlen(key);
+  return concurrent_copy_into(tbl_ptr, key, key_len, buf, cap, data_len, key_hash(hash_source(tbl_ptr), key, key_len));
+}
+
+uint8_t
+swiss_table_concurrent_get_into_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, char* buf, size_t cap, size_t* data_len)
+{
+  if (!tbl_ptr || !key || (!buf && cap)) {
+    return INVALID_ARGS;
+  }
+  uint64_t h;
+  if (!key_hash_n(hash_source(tbl_ptr), key, key_len, &h)) {
+    return OUT_OF_MEMORY;
+  }
+  return concurrent_copy_into(tbl_ptr, key, key_len, buf, cap, data_len, h);
+}
+
+uint8_t
+swiss_table_concurrent_reserve(swiss_table_concurrent_t* tbl_ptr, size_t entries)
+{
+  if (!tbl_ptr) {
+    return INVALID_ARGS;
+  }
+  size_t per_shard = (entries + tbl_ptr->_shard_count - 1) / tbl_ptr->_shard_count;
+  for (uint32_t index = 0; index < tbl_ptr->_shard_count; ++index) {
+    shard_t* shard = &tbl_ptr->_shards[index];
+    write_begin(shard);
+    uint8_t err = swiss_table_reserve(shard->_table, per_shard);
+    write_end(shard);
+    if (err != NO_ERR) {
+      return err;
+    }
+  }
+  return NO_ERR;
+}
+
+uint8_t
+swiss_table_concurrent_shrink_to_fit(swiss_table_concurrent_t* tbl_ptr)
+{
+  if (!tbl_ptr) {
+    return INVALID_ARGS;
+  }
+  for (uint32_t index = 0; index < tbl_ptr->_shard_count; ++index) {
+    shard_t* shard = &tbl_ptr->_shards[index];
+    write_begin(shard);
+    uint8_t err = swiss_table_shrink_to_fit(shard->_table);
+    write_end(shard);
+    if (err != NO_ERR) {
+      return err;
+    }
+  }
+  return NO_ERR;
+}
+
+uint8_t
+swiss_table_concurrent_compact(swiss_table_concurrent_t* tbl_ptr)
+{
+  if (!tbl_ptr) {
+    return INVALID_ARGS;
+  }
+  for (uint32_t index = 0; index < tbl_ptr->_shard_count; ++index) {
+    shard_t* shard = &tbl_ptr->_shards[index];
+    write_begin(shard);
+    swiss_table_compact(shard->_table);
+    write_end(shard);
+  }
+  return NO_ERR;
+}
+
+void
+swiss_table_concurrent_destroy(swiss_table_concurrent_t* tbl_ptr)
+{
+  if (!tbl_ptr) {
+    return;
   }
-  free(tbl_ptr->_control);
-  free(tbl_ptr->_groups);
-  free(tbl_ptr);
+  free_shards(tbl_ptr, tbl_ptr->_shard_count);
 }
@@ -1,229 +1,269 @@
-#include "../swiss_table.h"
-#include <omp.h>
+#include "../swiss_table_internal.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-#define GROUP_SIZE 16
-#define INITIAL_GROUP_COUNT 16
-#define MAX_FILL 0.7f
+/*
+ * Group match kernels. Every kernel turns one 16-byte load of control bytes
+ * into a bitmask with one bit per matching slot. Slot i of the group owns
+ * bit (i << GROUP_MASK_SHIFT); the NEON kernel produces a nibble per slot,
+ * the others a single bit. Full slots have the high bit clear, EMPTY and
+ * DELETED have it set, which the empty-or-deleted match relies on.
+ */
+typedef uint64_t group_mask_t;
 
-#define DELETED 0xfe
-#define EMPTY 0x80
+#if defined(__SSE2__)
 
-#define METADATA_MASK 0x7e
-#define HASH_MASK 0xffffffffffffff80
+#define GROUP_MASK_SHIFT 0
+#define GROUP_MASK_ALL 0xffffull
 
-struct swiss_table_node
+typedef __m128i group_t;
+
+static inline group_t
+group_load(const uint8_t* control)
 {
-  char* _key;
-  char* _data;
-};
+  return _mm_loadu_si128((const __m128i*)control);
+}
 
-struct swiss_table 
+static inline group_mask_t
+group_match(group_t group, uint8_t meta)
 {
-  uint8_t** _control;
-  node_t** _groups;
-  uint32_t _group_count;
-  uint32_t _current_size;
-  uint32_t _deleted;
-  uint64_t (*hash_f)(const char*);
-};
+  return (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)meta)));
+}
 
-static inline void
-find_metadata(int8_t* res, const uint8_t* data, const uint8_t meta)
+static inline group_mask_t
+group_match_empty_or_deleted(group_t group)
 {
-  #pragma omp simd
-  for (uint8_t i = 0; i < GROUP_SIZE; ++i) {
-    res[i] = (data[i] == meta);
-  }
+  return (uint16_t)_mm_movemask_epi8(group);
 }
 
-static uint64_t
-hash(const char* key)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+#define GROUP_MASK_SHIFT 2
+#define GROUP_MASK_ALL 0x8888888888888888ull
+
+typedef uint8x16_t group_t;
+
+static inline group_mask_t
+neon_mask(uint8x16_t cmp)
 {
-  static const uint16_t noise[] = { 18894, 1149, 9843, 5236, 21354, 26871, 21465, 17861, 2414, 5219, 24185, 5711, 866, 16758, 26915, 27184 };
-  uint64_t sum = 0, hash = 0;
-  for (uint32_t i = 0; i < strlen(key); ++i) {
-    sum += (key[i] * noise[i % 16]);
-  }
-  for (uint8_t i = 0; i < 8; ++i) {
-    hash ^= ((sum << i) | (sum >> (64 - i)));
-  }
-  return hash;
-}
-
-static void
-expand(swiss_table_t* tbl_ptr)
-{
-  tbl_ptr->_group_count *= 2;
-  tbl_ptr->_current_size = 0;
-  tbl_ptr->_deleted = 0;
-  node_t** tmp_groups = tbl_ptr->_groups;
-  uint8_t** tmp_control = tbl_ptr->_control;
-  tbl_ptr->_groups = (node_t**)malloc(tbl_ptr->_group_count * sizeof(node_t*));
-  tbl_ptr->_control = (uint8_t**)malloc(tbl_ptr->_group_count * sizeof(uint8_t*)); 
-  for (uint32_t i = 0; i < tbl_ptr->_group_count; ++i) {
-    tbl_ptr->_control[i] = (uint8_t*)malloc(GROUP_SIZE * sizeof(uint8_t));
-    memset(tbl_ptr->_control[i], EMPTY, GROUP_SIZE);
-    tbl_ptr->_groups[i] = (node_t*)calloc(GROUP_SIZE, sizeof(node_t));
-  }
-  for (uint32_t group_index = 0; group_index < tbl_ptr->_group_count / 2; ++group_index) {
-    for (uint8_t node_index = 0; node_index < GROUP_SIZE; ++node_index) {
-      if ((int8_t)tmp_control[group_index][node_index] >= 0) {
-        swiss_table_insert_update(tbl_ptr, tmp_groups[group_index][node_index]._key, tmp_groups[group_index][node_index]._data);
-        free(tmp_groups[group_index][node_index]._key);
-        free(tmp_groups[group_index][node_index]._data);
-      }
-    }
-    free(tmp_groups[group_index]);
-    free(tmp_control[group_index]);
-  }
-  free(tmp_groups);
-  free(tmp_control);
-}
-
-swiss_table_t*
-swiss_table_init(void)
-{
-  swiss_table_t* new_table = (swiss_table_t*)calloc(1, sizeof(swiss_table_t));
-  new_table->_group_count = INITIAL_GROUP_COUNT;
-  new_table->hash_f = &hash;
-  new_table->_control = (uint8_t**)malloc(INITIAL_GROUP_COUNT * sizeof(uint8_t*));
-  new_table->_groups = (node_t**)malloc(INITIAL_GROUP_COUNT * sizeof(node_t*));
-  for (uint8_t i = 0; i < INITIAL_GROUP_COUNT; ++i) {
-    new_table->_control[i] = (uint8_t*)malloc(GROUP_SIZE * sizeof(uint8_t));
-    memset(new_table->_control[i], EMPTY, GROUP_SIZE);
-    new_table->_groups[i] = (node_t*)calloc(GROUP_SIZE, sizeof(node_t));
-  }
-  return new_table;
+  uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & GROUP_MASK_ALL;
 }
 
-inline void
-swiss_table_set_hash(swiss_table_t* tbl_ptr, uint64_t (*hash_f)(const char*))
+static inline group_t
+group_load(const uint8_t* control)
 {
-  if (!tbl_ptr || !hash_f) {
-    return;
-  }
-  tbl_ptr->hash_f = hash_f;
+  return vld1q_u8(control);
 }
 
-uint8_t
-swiss_table_insert_update(swiss_table_t* tbl_ptr, const char* key, const char* data)
+static inline group_mask_t
+group_match(group_t group, uint8_t meta)
+{
+  return neon_mask(vceqq_u8(group, vdupq_n_u8(meta)));
+}
+
+static inline group_mask_t
+group_match_empty_or_deleted(group_t group)
+{
+  return neon_mask(vcltzq_s8(vreinterpretq_s8_u8(group)));
+}
+
+#else
+
+#define GROUP_MASK_SHIFT 0
+#define GROUP_MASK_ALL 0xffffull
+
+#define LSBS 0x0101010101010101ull
+#define MSBS 0x8080808080808080ull
+
+typedef struct
+{
+  uint64_t _lo;
+  uint64_t _hi;
+} group_t;
+
+static inline group_t
+group_load(const uint8_t* control)
+{
+  group_t group;
+  memcpy(&group._lo, control, sizeof(uint64_t));
+  memcpy(&group._hi, control + sizeof(uint64_t), sizeof(uint64_t));
+  return group;
+}
+
+/* Gathers the high bit of every byte into the low 8 bits. */
+static inline group_mask_t
+swar_pack(uint64_t msbs)
+{
+  return ((msbs & MSBS) * 0x0002040810204081ull) >> 56;
+}
+
+static inline group_mask_t
+swar_zero_bytes(uint64_t word)
+{
+  return swar_pack(~(((word & ~MSBS) + ~MSBS) | word | ~MSBS));
+}
+
+static inline group_mask_t
+group_match(group_t group, uint8_t meta)
+{
+  return swar_zero_bytes(group._lo ^ (LSBS * meta)) | (swar_zero_bytes(group._hi ^ (LSBS * meta)) << 8);
+}
+
+static inline group_mask_t
+group_match_empty_or_deleted(group_t group)
+{
+  return swar_pack(group._lo) | (swar_pack(group._hi) << 8);
+}
+
+#endif
+
+#define GROUP_MASK_BITS (GROUP_SIZE << GROUP_MASK_SHIFT)
+
+static inline group_mask_t
+group_match_empty(group_t group)
+{
+  return group_match(group, EMPTY);
+}
+
+static inline group_mask_t
+group_match_full(group_t group)
+{
+  return ~group_match_empty_or_deleted(group) & GROUP_MASK_ALL;
+}
+
+static inline uint32_t
+mask_lowest(group_mask_t mask)
+{
+  return (uint32_t)__builtin_ctzll(mask) >> GROUP_MASK_SHIFT;
+}
+
+static inline uint32_t
+mask_leading_zeros(group_mask_t mask)
+{
+  return (uint32_t)(__builtin_clzll(mask) - (64 - GROUP_MASK_BITS)) >> GROUP_MASK_SHIFT;
+}
+
+static uint32_t
+find(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h)
 {
-  if (!tbl_ptr || !key || !data) {
-    return INVALID_ARGS;
-  }
-  if (tbl_ptr->_current_size > tbl_ptr->_group_count * GROUP_SIZE * MAX_FILL) {
-    expand(tbl_ptr);
-  }
-  uint64_t h = tbl_ptr->hash_f(key);
   uint8_t metadata = h & METADATA_MASK;
-  for (uint64_t group_index = ((h & HASH_MASK) >> 7) % tbl_ptr->_group_count;;group_index = (group_index + 1) % tbl_ptr->_group_count) {
-    int8_t meta[GROUP_SIZE];
-    find_metadata(meta, tbl_ptr->_control[group_index], metadata);
-    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta[metadata_index]) {
-        if (!strcmp(tbl_ptr->_groups[group_index][metadata_index]._key, key)) {
-          free(tbl_ptr->_groups[group_index][metadata_index]._data);
-          tbl_ptr->_groups[group_index][metadata_index]._data = strdup(data);
-          return UPDATED;
-        }
+  for (uint32_t pos = probe_start(tbl_ptr, h), step = GROUP_SIZE;;pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    group_t group = group_load(tbl_ptr->_control + pos);
+    for (group_mask_t match = group_match(group, metadata); match; match &= match - 1) {
+      uint32_t index = (pos + mask_lowest(match)) & slot_mask(tbl_ptr);
+      if (STATS_TAG(tbl_ptr, node_has_key(&tbl_ptr->_slots[index], key, key_len, h))) {
+        STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+        return index;
       }
     }
-    find_metadata(meta, tbl_ptr->_control[group_index], EMPTY);
-    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta[metadata_index]) {
-        tbl_ptr->_control[group_index][metadata_index] = metadata;
-        tbl_ptr->_groups[group_index][metadata_index]._key = strdup( key);
-        tbl_ptr->_groups[group_index][metadata_index]._data = strdup( data);
-        ++tbl_ptr->_current_size;
-        return NO_ERR;
-      }
+    if (group_match_empty(group)) {
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return UINT32_MAX;
     }
   }
 }
 
-uint8_t
-swiss_table_delete(swiss_table_t* tbl_ptr, const char* key)
+static uint32_t
+find_slot(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h, uint8_t* found)
 {
-  if (!tbl_ptr || !key) {
-    return INVALID_ARGS;
-  }
-  uint64_t h = tbl_ptr->hash_f(key);
   uint8_t metadata = h & METADATA_MASK;
-  for (uint64_t group_index = ((h & HASH_MASK) >> 7) % tbl_ptr->_group_count;;group_index = (group_index + 1) % tbl_ptr->_group_count) {
-    int8_t meta[GROUP_SIZE];
-    find_metadata(meta, tbl_ptr->_control[group_index], metadata);
-    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta[metadata_index]) {
-        if (!strcmp(tbl_ptr->_groups[group_index][metadata_index]._key, key)) {
-          free(tbl_ptr->_groups[group_index][metadata_index]._key);
-          free(tbl_ptr->_groups[group_index][metadata_index]._data);
-          find_metadata(meta, tbl_ptr->_control[group_index], EMPTY);
-          for (uint8_t m = 0; m < GROUP_SIZE; ++m) {
-            if (meta[m]) {
-              tbl_ptr->_control[group_index][metadata_index] = EMPTY;
-              --tbl_ptr->_current_size;
-              return NO_ERR;
-            }
-          }
-          tbl_ptr->_control[group_index][metadata_index] = DELETED;
-          ++tbl_ptr->_deleted;
-          return NO_ERR;
-        }
+  uint32_t free_index = UINT32_MAX;
+  for (uint32_t pos = probe_start(tbl_ptr, h), step = GROUP_SIZE;;pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    group_t group = group_load(tbl_ptr->_control + pos);
+    for (group_mask_t match = group_match(group, metadata); match; match &= match - 1) {
+      uint32_t index = (pos + mask_lowest(match)) & slot_mask(tbl_ptr);
+      if (STATS_TAG(tbl_ptr, node_has_key(&tbl_ptr->_slots[index], key, key_len, h))) {
+        *found = 1;
+        STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+        return index;
       }
     }
-    find_metadata(meta, tbl_ptr->_control[group_index], EMPTY);
-    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta[metadata_index]) {
-        return KEY_NOT_FOUND;
+    if (free_index == UINT32_MAX) {
+      group_mask_t free_mask = group_match_empty_or_deleted(group);
+      if (free_mask) {
+        free_index = (pos + mask_lowest(free_mask)) & slot_mask(tbl_ptr);
       }
     }
+    if (group_match_empty(group)) {
+      *found = 0;
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return free_index;
+    }
   }
 }
 
-char*
-swiss_table_get_copy(const swiss_table_t* tbl_ptr, const char* key)
+static uint32_t
+find_free_slot(const swiss_table_t* tbl_ptr, uint64_t h)
 {
-  if (!tbl_ptr || !key) {
-    return NULL;
+  for (uint32_t pos = probe_start(tbl_ptr, h), step = GROUP_SIZE;;pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    group_mask_t free_mask = group_match_empty_or_deleted(group_load(tbl_ptr->_control + pos));
+    if (free_mask) {
+      return (pos + mask_lowest(free_mask)) & slot_mask(tbl_ptr);
+    }
   }
-  uint64_t h = tbl_ptr->hash_f(key);
+}
+
+static uint32_t
+find_match(const swiss_table_t* tbl_ptr, uint64_t h, uint32_t probe_limit, slot_match_f match, const void* ctx, uint32_t* free_slot)
+{
   uint8_t metadata = h & METADATA_MASK;
-  for (uint64_t group_index = ((h & HASH_MASK) >> 7) % tbl_ptr->_group_count;;group_index = (group_index + 1) % tbl_ptr->_group_count) {
-    int8_t meta[GROUP_SIZE];
-    find_metadata(meta, tbl_ptr->_control[group_index], metadata);
-    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta[metadata_index]) {
-        if (!strcmp(tbl_ptr->_groups[group_index][metadata_index]._key, key)) {
-          return strdup(tbl_ptr->_groups[group_index][metadata_index]._data);
-        }
+  uint32_t pos = probe_start(tbl_ptr, h);
+  if (free_slot) {
+    *free_slot = UINT32_MAX;
+  }
+  for (uint32_t probe = 0, step = GROUP_SIZE; probe < probe_limit; ++probe, pos = (pos + step) & slot_mask(tbl_ptr), step += GROUP_SIZE) {
+    group_t group = group_load(tbl_ptr->_control + pos);
+    for (group_mask_t candidates = group_match(group, metadata); candidates; candidates &= candidates - 1) {
+      uint32_t index = (pos + mask_lowest(candidates)) & slot_mask(tbl_ptr);
+      if (STATS_TAG(tbl_ptr, match(ctx, index))) {
+        STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+        return index;
       }
     }
-    find_metadata(meta, tbl_ptr->_control[group_index], EMPTY);
-    for (uint8_t metadata_index = 0; metadata_index < GROUP_SIZE; ++metadata_index) {
-      if (meta[metadata_index]) {
-        return NULL;
+    if (free_slot && *free_slot == UINT32_MAX) {
+      group_mask_t free_mask = group_match_empty_or_deleted(group);
+      if (free_mask) {
+        *free_slot = (pos + mask_lowest(free_mask)) & slot_mask(tbl_ptr);
       }
     }
+    if (group_match_empty(group)) {
+      STATS_PROBE(tbl_ptr, step / GROUP_SIZE);
+      return UINT32_MAX;
+    }
   }
+  STATS_PROBE(tbl_ptr, probe_limit);
+  return UINT32_MAX;
 }
 
-void
-swiss_table_destroy(swiss_table_t* tbl_ptr)
+static uint8_t
+was_never_full(const swiss_table_t* tbl_ptr, uint32_t index)
 {
-  if (!tbl_ptr) {
-    return;
-  }
-  for (uint32_t i = 0; i < tbl_ptr->_group_count; ++i) {
-    for (uint8_t m = 0; m < GROUP_SIZE; ++m) {
-      if ((int8_t)(tbl_ptr->_control[i][m]) >= 0) {
-        free(tbl_ptr->_groups[i][m]._key);
-        free(tbl_ptr->_groups[i][m]._data);
-      }
+  group_mask_t empty_after = group_match_empty(group_load(tbl_ptr->_control + index));
+  group_mask_t empty_before = group_match_empty(group_load(tbl_ptr->_control + ((index - GROUP_SIZE) & slot_mask(tbl_ptr))));
+  return empty_after && empty_before && mask_lowest(empty_after) + mask_leading_zeros(empty_before) < GROUP_SIZE;
+}
+
+static uint32_t
+next_full(const uint8_t* control, uint32_t capacity, uint32_t index)
+{
+  for (; index < capacity; index += GROUP_SIZE) {
+    group_mask_t full = group_match_full(group_load(control + index));
+    if (capacity - index < GROUP_SIZE) {
+      full &= ((group_mask_t)1 << ((capacity - index) << GROUP_MASK_SHIFT)) - 1;
+    }
+    if (full) {
+      return index + mask_lowest(full);
     }
-    free(tbl_ptr->_control[i]);
-    free(tbl_ptr->_groups[i]);
   }
-  free(tbl_ptr->_control);
-  free(tbl_ptr->_groups);
-  free(tbl_ptr);
+  return capacity;
 }
+
+const swiss_table_backend_t swiss_table_backend_simd = {
+  "simd", SWISS_TABLE_BACKEND_SIMD,
+  &find, &find_slot, &find_free_slot, &find_match, &was_never_full, &next_full,
+  NULL
+};
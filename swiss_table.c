@@ -0,0 +1,2300 @@
+#include "swiss_table_internal.h"
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+
+#define INITIAL_GROUP_COUNT 16
+#define MAX_FILL 0.7f
+/* Keeps at least one EMPTY slot in every table so probes terminate. */
+#define MAX_FILL_LIMIT 0.875f
+/* Old-array groups moved per insert or delete during an incremental resize. */
+#define MIGRATE_GROUPS 8
+/* Keys hashed and prefetched together by the batch calls. */
+#define BATCH_CHUNK 16
+
+static uint64_t
+hash_seed(const void* salt)
+{
+  static uint64_t counter;
+  uint64_t seed = 0;
+#if defined(__linux__)
+  if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == sizeof(seed)) {
+    return seed;
+  }
+#endif
+  seed = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(uintptr_t)salt;
+  return hash_mix(seed ^ hash_secret[0], __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED) ^ hash_secret[2]);
+}
+
+void*
+swiss_table_default_alloc(void* ctx, size_t size, size_t align)
+{
+  (void)ctx;
+  if (align <= _Alignof(max_align_t)) {
+    return malloc(size);
+  }
+  return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void
+swiss_table_default_free(void* ctx, void* ptr, size_t size)
+{
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+static inline uint8_t
+arena_class(size_t size)
+{
+  uint8_t size_class = 0;
+  while ((size_t)ARENA_MIN_CLASS << size_class < size) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+static void*
+arena_alloc(swiss_table_t* tbl_ptr, size_t size)
+{
+  arena_t* arena = &tbl_ptr->_arena;
+  uint8_t size_class = arena_class(size);
+  if (size_class >= ARENA_CLASS_COUNT) {
+    arena_block_t* block = (arena_block_t*)tbl_alloc(tbl_ptr, sizeof(arena_block_t) + size, sizeof(void*));
+    if (!block) {
+      return NULL;
+    }
+    block->_size = sizeof(arena_block_t) + size;
+    block->_prev = NULL;
+    block->_next = arena->_large;
+    if (arena->_large) {
+      arena->_large->_prev = block;
+    }
+    arena->_large = block;
+    return block + 1;
+  }
+  if (arena->_free[size_class]) {
+    void* ptr = arena->_free[size_class];
+    arena->_free[size_class] = *(void**)ptr;
+    return ptr;
+  }
+  size_t block_size = (size_t)ARENA_MIN_CLASS << size_class;
+  if ((size_t)(arena->_end - arena->_cursor) < block_size) {
+    arena_block_t* chunk = (arena_block_t*)tbl_alloc(tbl_ptr, ARENA_CHUNK_SIZE, ARENA_MIN_CLASS);
+    if (!chunk) {
+      return NULL;
+    }
+    chunk->_size = ARENA_CHUNK_SIZE;
+    chunk->_next = arena->_chunks;
+    arena->_chunks = chunk;
+    arena->_cursor = (char*)chunk + ARENA_MIN_CLASS * ((sizeof(arena_block_t) + ARENA_MIN_CLASS - 1) / ARENA_MIN_CLASS);
+    arena->_end = (char*)chunk + ARENA_CHUNK_SIZE;
+  }
+  void* ptr = arena->_cursor;
+  arena->_cursor += block_size;
+  return ptr;
+}
+
+static void
+arena_free(swiss_table_t* tbl_ptr, void* ptr, size_t size)
+{
+  arena_t* arena = &tbl_ptr->_arena;
+  uint8_t size_class = arena_class(size);
+  if (size_class >= ARENA_CLASS_COUNT) {
+    arena_block_t* block = (arena_block_t*)ptr - 1;
+    if (block->_prev) {
+      block->_prev->_next = block->_next;
+    } else {
+      arena->_large = block->_next;
+    }
+    if (block->_next) {
+      block->_next->_prev = block->_prev;
+    }
+    tbl_free(tbl_ptr, block, block->_size);
+    return;
+  }
+  *(void**)ptr = arena->_free[size_class];
+  arena->_free[size_class] = ptr;
+}
+
+static void
+arena_release(swiss_table_t* tbl_ptr)
+{
+  arena_t* arena = &tbl_ptr->_arena;
+  for (arena_block_t* next; arena->_chunks; arena->_chunks = next) {
+    next = arena->_chunks->_next;
+    tbl_free(tbl_ptr, arena->_chunks, arena->_chunks->_size);
+  }
+  for (arena_block_t* next; arena->_large; arena->_large = next) {
+    next = arena->_large->_next;
+    tbl_free(tbl_ptr, arena->_large, arena->_large->_size);
+  }
+}
+
+/* Table-owned copy of len bytes plus a terminating NUL. */
+static char*
+store_bytes(swiss_table_t* tbl_ptr, const char* src, size_t len)
+{
+  char* dst = tbl_ptr->_storage == SWISS_TABLE_STORAGE_ARENA ? (char*)arena_alloc(tbl_ptr, len + 1) : (char*)tbl_alloc(tbl_ptr, len + 1, 1);
+  if (dst) {
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+  }
+  return dst;
+}
+
+static void
+free_bytes(swiss_table_t* tbl_ptr, char* ptr, size_t len)
+{
+  if (tbl_ptr->_storage == SWISS_TABLE_STORAGE_ARENA) {
+    arena_free(tbl_ptr, ptr, len + 1);
+  } else {
+    tbl_free(tbl_ptr, ptr, len + 1);
+  }
+}
+
+static void
+free_retired(swiss_table_t* tbl_ptr, const retired_t* item)
+{
+  if (item->_bytes) {
+    free_bytes(tbl_ptr, (char*)item->_ptr, item->_size);
+  } else {
+    tbl_free(tbl_ptr, item->_ptr, item->_size);
+  }
+}
+
+/* Releases every retired block no active reader can still reach. */
+static void
+reclaim_collect(swiss_table_t* tbl_ptr)
+{
+  reclaim_t* reclaim = tbl_ptr->_reclaim;
+  atomic_fetch_add(&reclaim->_domain->_epoch, 1);
+  uint64_t oldest = UINT64_MAX;
+  for (uint32_t index = 0; index < READER_SLOTS; ++index) {
+    uint64_t epoch = atomic_load(&reclaim->_domain->_readers[index]._epoch);
+    if (epoch && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+  size_t kept = 0;
+  for (size_t index = 0; index < reclaim->_count; ++index) {
+    if (reclaim->_items[index]._epoch < oldest) {
+      free_retired(tbl_ptr, &reclaim->_items[index]);
+    } else {
+      reclaim->_items[kept++] = reclaim->_items[index];
+    }
+  }
+  reclaim->_count = kept;
+}
+
+static void
+retire(swiss_table_t* tbl_ptr, void* ptr, size_t size, uint8_t bytes)
+{
+  reclaim_t* reclaim = tbl_ptr->_reclaim;
+  if (reclaim->_count == reclaim->_cap) {
+    reclaim_collect(tbl_ptr);
+  }
+  if (reclaim->_count == reclaim->_cap) {
+    size_t cap = reclaim->_cap ? reclaim->_cap * 2 : RECLAIM_BATCH;
+    retired_t* items = (retired_t*)tbl_alloc(tbl_ptr, cap * sizeof(retired_t), _Alignof(retired_t));
+    if (items) {
+      memcpy(items, reclaim->_items, reclaim->_count * sizeof(retired_t));
+      tbl_free(tbl_ptr, reclaim->_items, reclaim->_cap * sizeof(retired_t));
+      reclaim->_items = items;
+      reclaim->_cap = cap;
+    }
+    /* Readers never block, so waiting for them always finishes. */
+    while (reclaim->_count == reclaim->_cap) {
+      sched_yield();
+      reclaim_collect(tbl_ptr);
+    }
+  }
+  retired_t* item = &reclaim->_items[reclaim->_count++];
+  item->_ptr = ptr;
+  item->_size = size;
+  item->_epoch = atomic_load(&reclaim->_domain->_epoch);
+  item->_bytes = bytes;
+}
+
+void
+swiss_table_reclaim_release(swiss_table_t* tbl_ptr)
+{
+  reclaim_t* reclaim = tbl_ptr->_reclaim;
+  for (size_t index = 0; index < reclaim->_count; ++index) {
+    free_retired(tbl_ptr, &reclaim->_items[index]);
+  }
+  tbl_free(tbl_ptr, reclaim->_items, reclaim->_cap * sizeof(retired_t));
+  reclaim->_items = NULL;
+  reclaim->_count = reclaim->_cap = 0;
+  tbl_ptr->_reclaim = NULL;
+}
+
+static void
+release_bytes(swiss_table_t* tbl_ptr, char* ptr, size_t len)
+{
+  if (!ptr) {
+    return;
+  }
+  if (tbl_ptr->_reclaim) {
+    retire(tbl_ptr, ptr, len, 1);
+  } else {
+    free_bytes(tbl_ptr, ptr, len);
+  }
+}
+
+/* Sets the node's key, inline or as a table-owned copy; 0 if the copy fails. */
+static inline uint8_t
+node_store_key(swiss_table_t* tbl_ptr, node_t* node, const char* key, size_t key_len)
+{
+  node->_key_len = key_len;
+  if (key_len < INLINE_KEY_SIZE) {
+    memcpy(node->_key._inline, key, key_len);
+    node->_key._inline[key_len] = '\0';
+    return 1;
+  }
+  node->_key._ptr = store_bytes(tbl_ptr, key, key_len);
+  return node->_key._ptr != NULL;
+}
+
+static inline void
+node_release_key(swiss_table_t* tbl_ptr, const node_t* node)
+{
+  if (node->_key_len >= INLINE_KEY_SIZE) {
+    release_bytes(tbl_ptr, node->_key._ptr, node->_key_len);
+  }
+}
+
+static inline uint32_t
+growth_limit(const swiss_table_t* tbl_ptr)
+{
+  return capacity(tbl_ptr) * tbl_ptr->_max_load;
+}
+
+/* Smallest group count that holds entries without exceeding max_load, or 0. */
+static uint32_t
+group_count_for(size_t entries, float max_load)
+{
+  for (uint32_t group_count = 1; group_count <= MAX_GROUP_COUNT; group_count *= 2) {
+    if (entries <= (size_t)(group_count * GROUP_SIZE * max_load)) {
+      return group_count;
+    }
+  }
+  return 0;
+}
+
+static void
+free_arrays(const swiss_table_t* tbl_ptr, uint8_t* control, node_t* slots, uint32_t capacity)
+{
+  tbl_free(tbl_ptr, control, control_size(capacity));
+  tbl_free(tbl_ptr, slots, (size_t)capacity * sizeof(node_t));
+}
+
+static uint8_t
+alloc_arrays(swiss_table_t* tbl_ptr)
+{
+  tbl_ptr->_control = (uint8_t*)tbl_alloc(tbl_ptr, control_size(capacity(tbl_ptr)), GROUP_SIZE);
+  tbl_ptr->_slots = (node_t*)tbl_alloc(tbl_ptr, (size_t)capacity(tbl_ptr) * sizeof(node_t), _Alignof(node_t));
+  if (!tbl_ptr->_control || !tbl_ptr->_slots) {
+    free_arrays(tbl_ptr, tbl_ptr->_control, tbl_ptr->_slots, capacity(tbl_ptr));
+    return 0;
+  }
+  memset(tbl_ptr->_control, EMPTY, control_size(capacity(tbl_ptr)));
+  return 1;
+}
+
+/* free_arrays for arrays that lock-free readers may have loaded. */
+static void
+release_arrays(swiss_table_t* tbl_ptr, uint8_t* control, node_t* slots, uint32_t capacity)
+{
+  if (tbl_ptr->_reclaim) {
+    retire(tbl_ptr, control, control_size(capacity), 0);
+    retire(tbl_ptr, slots, (size_t)capacity * sizeof(node_t), 0);
+  } else {
+    free_arrays(tbl_ptr, control, slots, capacity);
+  }
+}
+
+static inline uint32_t
+find_free_slot(const swiss_table_t* tbl_ptr, uint64_t h)
+{
+  return tbl_ptr->_backend->find_free_slot(tbl_ptr, h);
+}
+
+/* First full slot at or after index in view's arrays, capacity(view) if none. */
+static inline uint32_t
+next_full(const swiss_table_t* view, uint32_t index)
+{
+  return view->_backend->next_full(view->_control, capacity(view), index);
+}
+
+/* Timestamp for rehash_ns. */
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  timespec_get(&ts, TIME_UTC);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Moves every entry into fresh arrays of group_count groups; 0 if
+ * allocation fails. The arrays are filled through a private copy of the
+ * table and only then published, so lock-free readers never load them
+ * half built.
+ */
+static uint8_t
+resize(swiss_table_t* tbl_ptr, uint32_t group_count)
+{
+  uint64_t started = now_ns();
+  uint32_t old_capacity = capacity(tbl_ptr);
+  uint8_t* old_control = tbl_ptr->_control;
+  node_t* old_slots = tbl_ptr->_slots;
+  swiss_table_t next = *tbl_ptr;
+  next._group_count = group_count;
+  if (!alloc_arrays(&next)) {
+    return 0;
+  }
+  if (next._backend->place_all) {
+    next._current_size = next._backend->place_all(&next, old_slots, old_control, old_capacity, 0);
+  } else {
+    next._current_size = 0;
+    for (uint32_t old_index = next._backend->next_full(old_control, old_capacity, 0); old_index < old_capacity;
+         old_index = next._backend->next_full(old_control, old_capacity, old_index + 1)) {
+      node_t* node = &old_slots[old_index];
+      uint32_t index = find_free_slot(&next, node->_hash);
+      set_control(&next, index, node->_hash & METADATA_MASK);
+      next._slots[index] = *node;
+      ++next._current_size;
+    }
+  }
+  __atomic_store_n(&tbl_ptr->_control, next._control, __ATOMIC_RELEASE);
+  __atomic_store_n(&tbl_ptr->_slots, next._slots, __ATOMIC_RELEASE);
+  __atomic_store_n(&tbl_ptr->_group_count, group_count, __ATOMIC_RELEASE);
+  tbl_ptr->_current_size = next._current_size;
+  tbl_ptr->_deleted = 0;
+  release_arrays(tbl_ptr, old_control, old_slots, old_capacity);
+  ++tbl_ptr->_resizes;
+  tbl_ptr->_rehash_ns += now_ns() - started;
+  return 1;
+}
+
+/* Entry access rehash_in_place needs, for the map's nodes or a set's keys. */
+typedef struct slot_array
+{
+  /* Full hash of the entry at index. */
+  uint64_t (*hash)(const swiss_table_t* tbl_ptr, uint32_t index);
+  void (*move)(swiss_table_t* tbl_ptr, uint32_t to, uint32_t from);
+  void (*swap)(swiss_table_t* tbl_ptr, uint32_t lhs, uint32_t rhs);
+} slot_array_t;
+
+/*
+ * Rehash in place at the same capacity so every tombstone becomes EMPTY.
+ * Full slots are first marked DELETED, then each is moved to the first
+ * free slot of its probe sequence unless it already sits in the right
+ * group; a DELETED target still holds an unprocessed entry, so the two
+ * are swapped and the current slot is processed again.
+ */
+static void
+rehash_in_place(swiss_table_t* tbl_ptr, const slot_array_t* array)
+{
+  uint64_t started = now_ns();
+  uint8_t* control = tbl_ptr->_control;
+  for (uint32_t index = 0; index < capacity(tbl_ptr); ++index) {
+    set_control(tbl_ptr, index, (int8_t)control[index] >= 0 ? DELETED : EMPTY);
+  }
+  for (uint32_t index = 0; index < capacity(tbl_ptr); ++index) {
+    if (control[index] != DELETED) {
+      continue;
+    }
+    uint64_t h = array->hash(tbl_ptr, index);
+    uint8_t metadata = h & METADATA_MASK;
+    uint32_t start = probe_start(tbl_ptr, h);
+    uint32_t target = find_free_slot(tbl_ptr, h);
+    if (((target - start) & slot_mask(tbl_ptr)) / GROUP_SIZE == ((index - start) & slot_mask(tbl_ptr)) / GROUP_SIZE) {
+      set_control(tbl_ptr, index, metadata);
+      continue;
+    }
+    if (control[target] == EMPTY) {
+      set_control(tbl_ptr, target, metadata);
+      array->move(tbl_ptr, target, index);
+      set_control(tbl_ptr, index, EMPTY);
+      continue;
+    }
+    set_control(tbl_ptr, target, metadata);
+    array->swap(tbl_ptr, target, index);
+    --index;
+  }
+  tbl_ptr->_deleted = 0;
+  ++tbl_ptr->_compactions;
+  tbl_ptr->_rehash_ns += now_ns() - started;
+}
+
+static uint64_t
+node_hash_at(const swiss_table_t* tbl_ptr, uint32_t index)
+{
+  return tbl_ptr->_slots[index]._hash;
+}
+
+static void
+node_move(swiss_table_t* tbl_ptr, uint32_t to, uint32_t from)
+{
+  store_node(&tbl_ptr->_slots[to], &tbl_ptr->_slots[from]);
+}
+
+static void
+node_swap(swiss_table_t* tbl_ptr, uint32_t lhs, uint32_t rhs)
+{
+  node_t tmp = tbl_ptr->_slots[lhs];
+  store_node(&tbl_ptr->_slots[lhs], &tbl_ptr->_slots[rhs]);
+  store_node(&tbl_ptr->_slots[rhs], &tmp);
+}
+
+static const slot_array_t node_array = { &node_hash_at, &node_move, &node_swap };
+
+static void
+drop_deleted(swiss_table_t* tbl_ptr)
+{
+  rehash_in_place(tbl_ptr, &node_array);
+}
+
+static void
+merge_counters(stats_counters_t* dst, const stats_counters_t* src)
+{
+  for (uint32_t bucket = 0; bucket < SWISS_TABLE_PROBE_BUCKETS; ++bucket) {
+    dst->_probe_groups[bucket] += src->_probe_groups[bucket];
+  }
+  dst->_tag_hits += src->_tag_hits;
+  dst->_tag_false_positives += src->_tag_false_positives;
+}
+
+/* Moves up to group_limit groups of the old arrays; frees them when drained. */
+static void
+migrate(swiss_table_t* tbl_ptr, uint32_t group_limit)
+{
+#if defined(SWISS_TABLE_STATS)
+  uint64_t started = now_ns();
+#endif
+  swiss_table_t* old = tbl_ptr->_old;
+  uint32_t end = capacity(old);
+  if (group_limit < (end - tbl_ptr->_migrate_pos) / GROUP_SIZE) {
+    end = tbl_ptr->_migrate_pos + group_limit * GROUP_SIZE;
+  }
+  for (uint32_t pos = tbl_ptr->_migrate_pos; pos < end; ++pos) {
+    if ((int8_t)old->_control[pos] >= 0) {
+      node_t* node = &old->_slots[pos];
+      uint32_t index = find_free_slot(tbl_ptr, node->_hash);
+      if (tbl_ptr->_control[index] == DELETED) {
+        --tbl_ptr->_deleted;
+      }
+      set_control(tbl_ptr, index, node->_hash & METADATA_MASK);
+      store_node(&tbl_ptr->_slots[index], node);
+      set_control(old, pos, DELETED);
+    }
+  }
+  tbl_ptr->_migrate_pos = end;
+#if defined(SWISS_TABLE_STATS)
+  tbl_ptr->_rehash_ns += now_ns() - started;
+#endif
+  if (end == capacity(old)) {
+    /* Lookups that fell through to the old arrays counted there. */
+    merge_counters(&tbl_ptr->_counters, &old->_counters);
+    free_arrays(tbl_ptr, old->_control, old->_slots, capacity(old));
+    tbl_free(tbl_ptr, old, sizeof(swiss_table_t));
+    tbl_ptr->_old = NULL;
+  }
+}
+
+/* Incremental counterpart of resize: doubles, but leaves the entries in place. */
+static uint8_t
+start_migration(swiss_table_t* tbl_ptr)
+{
+  uint64_t started = now_ns();
+  swiss_table_t* old = (swiss_table_t*)tbl_alloc(tbl_ptr, sizeof(swiss_table_t), _Alignof(swiss_table_t));
+  if (!old) {
+    return 0;
+  }
+  memset(old, 0, sizeof(swiss_table_t));
+  old->_backend = tbl_ptr->_backend;
+  old->_control = tbl_ptr->_control;
+  old->_slots = tbl_ptr->_slots;
+  old->_group_count = tbl_ptr->_group_count;
+  tbl_ptr->_group_count *= 2;
+  if (!alloc_arrays(tbl_ptr)) {
+    tbl_ptr->_group_count = old->_group_count;
+    tbl_ptr->_control = old->_control;
+    tbl_ptr->_slots = old->_slots;
+    tbl_free(tbl_ptr, old, sizeof(swiss_table_t));
+    return 0;
+  }
+  tbl_ptr->_deleted = 0;
+  tbl_ptr->_old = old;
+  tbl_ptr->_migrate_pos = 0;
+  ++tbl_ptr->_resizes;
+  tbl_ptr->_rehash_ns += now_ns() - started;
+  return 1;
+}
+
+static inline void
+finish_migration(swiss_table_t* tbl_ptr)
+{
+  if (tbl_ptr->_old) {
+    migrate(tbl_ptr, UINT32_MAX);
+  }
+}
+
+/*
+ * Called when live entries plus tombstones pass the fill limit. Returns 0
+ * if the table could neither grow nor get under the limit by dropping
+ * tombstones; a new entry would then use up the EMPTY slots that end
+ * every probe.
+ */
+static uint8_t
+make_room(swiss_table_t* tbl_ptr)
+{
+  finish_migration(tbl_ptr);
+  if (tbl_ptr->_current_size <= growth_limit(tbl_ptr) / 2 || tbl_ptr->_group_count == MAX_GROUP_COUNT
+      || !(tbl_ptr->_incremental ? start_migration(tbl_ptr) : resize(tbl_ptr, tbl_ptr->_group_count * 2))) {
+    drop_deleted(tbl_ptr);
+  }
+  return tbl_ptr->_current_size + tbl_ptr->_deleted <= growth_limit(tbl_ptr);
+}
+
+/* Copies key and value into the free slot at index; 0 and the slot left free if either copy fails. */
+static uint8_t
+place_node(swiss_table_t* tbl_ptr, uint32_t index, const char* key, size_t key_len, const char* data, size_t data_len, uint64_t h)
+{
+  node_t placed;
+  if (!node_store_key(tbl_ptr, &placed, key, key_len)) {
+    return 0;
+  }
+  placed._data = store_bytes(tbl_ptr, data, data_len);
+  if (!placed._data) {
+    if (key_len >= INLINE_KEY_SIZE) {
+      free_bytes(tbl_ptr, placed._key._ptr, key_len);
+    }
+    return 0;
+  }
+  placed._data_len = data_len;
+  placed._hash = h;
+  if (tbl_ptr->_control[index] == DELETED) {
+    --tbl_ptr->_deleted;
+  }
+  store_node(&tbl_ptr->_slots[index], &placed);
+  set_control(tbl_ptr, index, h & METADATA_MASK);
+  ++tbl_ptr->_current_size;
+  return 1;
+}
+
+static const swiss_table_backend_t* const backends[] = { NULL, &swiss_table_backend_cons, &swiss_table_backend_simd, &swiss_table_backend_parallel };
+
+#define BACKEND_COUNT (sizeof(backends) / sizeof(backends[0]))
+
+/* Backend a SWISS_TABLE_BACKEND_* value stands for, NULL if unknown. */
+static const swiss_table_backend_t*
+select_backend(uint8_t backend)
+{
+  if (backend >= BACKEND_COUNT) {
+    return NULL;
+  }
+  if (backend != SWISS_TABLE_BACKEND_AUTO) {
+    return backends[backend];
+  }
+  const char* name = getenv("SWISS_TABLE_BACKEND");
+  for (uint8_t index = 1; name && index < BACKEND_COUNT; ++index) {
+    if (!strcmp(name, backends[index]->_name)) {
+      return backends[index];
+    }
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  if (!__builtin_cpu_supports("sse2")) {
+    return &swiss_table_backend_cons;
+  }
+#endif
+  return &swiss_table_backend_simd;
+}
+
+/*
+ * Validates opts (may be NULL) and fills a zeroed header with what tables
+ * and sets share: allocator, storage, backend, max_load, incremental flag
+ * and the initial group count. 0 if the options are invalid.
+ */
+static uint8_t
+apply_options(swiss_table_t* header, const swiss_table_options_t* opts)
+{
+  memset(header, 0, sizeof(swiss_table_t));
+  swiss_table_allocator_t allocator = { &swiss_table_default_alloc, &swiss_table_default_free, NULL };
+  if (opts && opts->allocator.alloc && opts->allocator.free) {
+    allocator = opts->allocator;
+  }
+  if (opts && opts->storage > SWISS_TABLE_STORAGE_ARENA) {
+    return 0;
+  }
+  const swiss_table_backend_t* backend = select_backend(opts ? opts->backend : SWISS_TABLE_BACKEND_AUTO);
+  float max_load = opts && opts->max_load ? opts->max_load : MAX_FILL;
+  if (!backend || !(max_load > 0 && max_load <= MAX_FILL_LIMIT)) {
+    return 0;
+  }
+  uint32_t group_count = INITIAL_GROUP_COUNT;
+  if (opts && opts->capacity) {
+    group_count = group_count_for(opts->capacity, max_load);
+    if (!group_count) {
+      return 0;
+    }
+  }
+  header->_allocator = allocator;
+  header->_storage = opts ? opts->storage : SWISS_TABLE_STORAGE_HEAP;
+  header->_group_count = group_count;
+  header->_max_load = max_load;
+  header->_incremental = opts && opts->incremental_resize;
+  header->_backend = backend;
+  return 1;
+}
+
+swiss_table_t*
+swiss_table_init_opts(const swiss_table_options_t* opts)
+{
+  swiss_table_t header;
+  if (!apply_options(&header, opts)) {
+    return NULL;
+  }
+  swiss_table_t* new_table = (swiss_table_t*)tbl_alloc(&header, sizeof(swiss_table_t), _Alignof(swiss_table_t));
+  if (!new_table) {
+    return NULL;
+  }
+  *new_table = header;
+  new_table->_seed = hash_seed(new_table);
+  if (!alloc_arrays(new_table)) {
+    tbl_free(&header, new_table, sizeof(swiss_table_t));
+    return NULL;
+  }
+  return new_table;
+}
+
+swiss_table_t*
+swiss_table_init(void)
+{
+  return swiss_table_init_opts(NULL);
+}
+
+swiss_table_t*
+swiss_table_init_with(size_t capacity, float max_load)
+{
+  swiss_table_options_t opts = { 0 };
+  opts.capacity = capacity;
+  opts.max_load = max_load;
+  return swiss_table_init_opts(&opts);
+}
+
+swiss_table_t*
+swiss_table_init_ex(uint8_t backend)
+{
+  swiss_table_options_t opts = { 0 };
+  opts.backend = backend;
+  return swiss_table_init_opts(&opts);
+}
+
+uint8_t
+swiss_table_get_backend(const swiss_table_t* tbl_ptr)
+{
+  return tbl_ptr ? tbl_ptr->_backend->_id : SWISS_TABLE_BACKEND_AUTO;
+}
+
+const char*
+swiss_table_backend_name(uint8_t backend)
+{
+  if (backend >= BACKEND_COUNT) {
+    return NULL;
+  }
+  return backend == SWISS_TABLE_BACKEND_AUTO ? "auto" : backends[backend]->_name;
+}
+
+/*
+ * Bulk build for backends with place_all. Hashes every pair in parallel,
+ * places them while the nodes still borrow the caller's long keys (short
+ * ones are already inline) and carry their source index in _data so the
+ * last duplicate wins, then copies keys and values into table-owned
+ * storage, in parallel when that storage is plain malloc. 0 on invalid
+ * input or allocation failure.
+ */
+static uint8_t
+build_placed(swiss_table_t* new_table, const char* const* keys, const size_t* key_lens, const char* const* datas, const size_t* data_lens, size_t n)
+{
+  node_t* nodes = (node_t*)tbl_alloc(new_table, n * sizeof(node_t), _Alignof(node_t));
+  if (!nodes) {
+    return 0;
+  }
+  uint8_t invalid = 0;
+  #pragma omp parallel for if(n >= PARALLEL_MIN_ENTRIES) reduction(|:invalid)
+  for (size_t index = 0; index < n; ++index) {
+    if (!keys[index] || !datas[index]) {
+      invalid = 1;
+      continue;
+    }
+    size_t key_len = key_lens ? key_lens[index] : strlen(keys[index]);
+    size_t data_len = data_lens ? data_lens[index] : strlen(datas[index]);
+    if (key_len > UINT32_MAX || data_len > UINT32_MAX) {
+      invalid = 1;
+      continue;
+    }
+    node_t* node = &nodes[index];
+    node->_key_len = key_len;
+    if (key_len < INLINE_KEY_SIZE) {
+      memcpy(node->_key._inline, keys[index], key_len);
+      node->_key._inline[key_len] = '\0';
+    } else {
+      node->_key._ptr = (char*)keys[index];
+    }
+    node->_data = (char*)(uintptr_t)index;
+    node->_data_len = data_len;
+    if (!key_lens) {
+      node->_hash = key_hash(new_table, keys[index], key_len);
+    } else if (!key_hash_n(new_table, keys[index], key_len, &node->_hash)) {
+      invalid = 1;
+    }
+  }
+  if (invalid) {
+    tbl_free(new_table, nodes, n * sizeof(node_t));
+    return 0;
+  }
+  new_table->_current_size = new_table->_backend->place_all(new_table, nodes, NULL, n, 1);
+  tbl_free(new_table, nodes, n * sizeof(node_t));
+  uint8_t private_storage = new_table->_storage == SWISS_TABLE_STORAGE_HEAP && new_table->_allocator.alloc == &swiss_table_default_alloc;
+  uint32_t dropped = 0;
+  #pragma omp parallel for if(private_storage && n >= PARALLEL_MIN_ENTRIES) schedule(static) reduction(+:dropped)
+  for (uint32_t index = 0; index < capacity(new_table); ++index) {
+    if ((int8_t)new_table->_control[index] >= 0) {
+      node_t* node = &new_table->_slots[index];
+      const char* key = node->_key._ptr;
+      uint8_t key_ok = node->_key_len < INLINE_KEY_SIZE || node_store_key(new_table, node, key, node->_key_len);
+      node->_data = store_bytes(new_table, datas[(uintptr_t)node->_data], node->_data_len);
+      if (!key_ok || !node->_data) {
+        /* Free whichever copy succeeded and empty the slot, so destroy never sees a borrowed key or a NULL value. */
+        if (key_ok) {
+          node_release_key(new_table, node);
+        }
+        release_bytes(new_table, node->_data, node->_data_len);
+        set_control(new_table, index, EMPTY);
+        ++dropped;
+      }
+    }
+  }
+  new_table->_current_size -= dropped;
+  return !dropped;
+}
+
+swiss_table_t*
+swiss_table_build_from(const swiss_table_options_t* opts, const char* const* keys, const size_t* key_lens, const char* const* datas, const size_t* data_lens, size_t n)
+{
+  if (n >= UINT32_MAX || (n && (!keys || !datas))) {
+    return NULL;
+  }
+  swiss_table_options_t build_opts = { 0 };
+  if (opts) {
+    build_opts = *opts;
+  }
+  if (build_opts.capacity < n) {
+    build_opts.capacity = n;
+  }
+  swiss_table_t* new_table = swiss_table_init_opts(&build_opts);
+  if (!new_table || !n) {
+    return new_table;
+  }
+  uint8_t ok = new_table->_backend->place_all ? build_placed(new_table, keys, key_lens, datas, data_lens, n)
+    : swiss_table_insert_batch(new_table, keys, key_lens, datas, data_lens, n, NULL) == NO_ERR;
+  if (!ok) {
+    swiss_table_destroy(new_table);
+    return NULL;
+  }
+  return new_table;
+}
+
+void
+swiss_table_set_hash(swiss_table_t* tbl_ptr, uint64_t (*hash_f)(const char*))
+{
+  if (!tbl_ptr || !hash_f) {
+    return;
+  }
+  tbl_ptr->hash_f = hash_f;
+}
+
+void
+swiss_table_set_hash_n(swiss_table_t* tbl_ptr, uint64_t (*hash_n_f)(const char*, size_t))
+{
+  if (!tbl_ptr || !hash_n_f) {
+    return;
+  }
+  tbl_ptr->hash_n_f = hash_n_f;
+}
+
+static const node_t* find(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h);
+
+/* Deletes key from the arrays an incremental resize has not drained yet. */
+static uint8_t
+erase_old(swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h)
+{
+  swiss_table_t* old = tbl_ptr->_old;
+  const node_t* node = old ? find(old, key, key_len, h) : NULL;
+  if (!node) {
+    return KEY_NOT_FOUND;
+  }
+  node_release_key(tbl_ptr, node);
+  release_bytes(tbl_ptr, node->_data, node->_data_len);
+  set_control(old, node - old->_slots, DELETED);
+  --tbl_ptr->_current_size;
+  return NO_ERR;
+}
+
+static uint8_t
+insert_update(swiss_table_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len, uint64_t h)
+{
+  if (tbl_ptr->_old) {
+    migrate(tbl_ptr, MIGRATE_GROUPS);
+  }
+  node_t* node = tbl_ptr->_old ? (node_t*)find(tbl_ptr->_old, key, key_len, h) : NULL;
+  if (!node) {
+    uint8_t found = 0;
+    uint32_t index = tbl_ptr->_backend->find_slot(tbl_ptr, key, key_len, h, &found);
+    if (!found) {
+      /* Only a new key needs room, so updates never rehash or fail to grow. */
+      if (tbl_ptr->_current_size + tbl_ptr->_deleted > growth_limit(tbl_ptr)) {
+        if (!make_room(tbl_ptr)) {
+          return OUT_OF_MEMORY;
+        }
+        /* The entries moved; the key is still absent, so any free slot of its probe will do. */
+        index = find_free_slot(tbl_ptr, h);
+      }
+      return place_node(tbl_ptr, index, key, key_len, data, data_len, h) ? NO_ERR : OUT_OF_MEMORY;
+    }
+    node = &tbl_ptr->_slots[index];
+  }
+  /* The old value stays in place unless the new one could be stored. */
+  char* stored = store_bytes(tbl_ptr, data, data_len);
+  if (!stored) {
+    return OUT_OF_MEMORY;
+  }
+  release_bytes(tbl_ptr, node->_data, node->_data_len);
+  __atomic_store_n(&node->_data, stored, __ATOMIC_RELAXED);
+  __atomic_store_n(&node->_data_len, (uint32_t)data_len, __ATOMIC_RELAXED);
+  return UPDATED;
+}
+
+static uint8_t
+erase(swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h)
+{
+  if (tbl_ptr->_old) {
+    migrate(tbl_ptr, MIGRATE_GROUPS);
+  }
+  uint32_t index = tbl_ptr->_backend->find(tbl_ptr, key, key_len, h);
+  if (index == UINT32_MAX) {
+    return erase_old(tbl_ptr, key, key_len, h);
+  }
+  node_t* node = &tbl_ptr->_slots[index];
+  node_release_key(tbl_ptr, node);
+  release_bytes(tbl_ptr, node->_data, node->_data_len);
+  if (tbl_ptr->_backend->was_never_full(tbl_ptr, index)) {
+    set_control(tbl_ptr, index, EMPTY);
+  } else {
+    set_control(tbl_ptr, index, DELETED);
+    ++tbl_ptr->_deleted;
+  }
+  --tbl_ptr->_current_size;
+  return NO_ERR;
+}
+
+static const node_t*
+find(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h)
+{
+  uint32_t index = tbl_ptr->_backend->find(tbl_ptr, key, key_len, h);
+  if (index != UINT32_MAX) {
+    return &tbl_ptr->_slots[index];
+  }
+  return tbl_ptr->_old ? find(tbl_ptr->_old, key, key_len, h) : NULL;
+}
+
+uint8_t
+swiss_table_insert_hashed(swiss_table_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len, uint64_t h)
+{
+  return insert_update(tbl_ptr, key, key_len, data, data_len, h);
+}
+
+uint8_t
+swiss_table_erase_hashed(swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h)
+{
+  return erase(tbl_ptr, key, key_len, h);
+}
+
+uint8_t
+swiss_table_insert_update(swiss_table_t* tbl_ptr, const char* key, const char* data)
+{
+  if (!tbl_ptr || !key || !data) {
+    return INVALID_ARGS;
+  }
+  size_t key_len = strlen(key), data_len = strlen(data);
+  if (key_len > UINT32_MAX || data_len > UINT32_MAX) {
+    return INVALID_ARGS;
+  }
+  return insert_update(tbl_ptr, key, key_len, data, data_len, key_hash(tbl_ptr, key, key_len));
+}
+
+uint8_t
+swiss_table_insert_update_n(swiss_table_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len)
+{
+  if (!tbl_ptr || !key || !data || key_len > UINT32_MAX || data_len > UINT32_MAX) {
+    return INVALID_ARGS;
+  }
+  uint64_t h;
+  if (!key_hash_n(tbl_ptr, key, key_len, &h)) {
+    return OUT_OF_MEMORY;
+  }
+  return insert_update(tbl_ptr, key, key_len, data, data_len, h);
+}
+
+uint8_t
+swiss_table_delete(swiss_table_t* tbl_ptr, const char* key)
+{
+  if (!tbl_ptr || !key) {
+    return INVALID_ARGS;
+  }
+  size_t key_len = strlen(key);
+  return erase(tbl_ptr, key, key_len, key_hash(tbl_ptr, key, key_len));
+}
+
+uint8_t
+swiss_table_delete_n(swiss_table_t* tbl_ptr, const char* key, size_t key_len)
+{
+  if (!tbl_ptr || !key) {
+    return INVALID_ARGS;
+  }
+  uint64_t h;
+  if (!key_hash_n(tbl_ptr, key, key_len, &h)) {
+    return OUT_OF_MEMORY;
+  }
+  return erase(tbl_ptr, key, key_len, h);
+}
+
+char*
+swiss_table_get_copy(const swiss_table_t* tbl_ptr, const char* key)
+{
+  if (!tbl_ptr || !key) {
+    return NULL;
+  }
+  size_t key_len = strlen(key);
+  const node_t* node = find(tbl_ptr, key, key_len, key_hash(tbl_ptr, key, key_len));
+  return node ? dup_bytes(node->_data, node->_data_len) : NULL;
+}
+
+char*
+swiss_table_get_copy_n(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, size_t* data_len)
+{
+  uint64_t h;
+  if (!tbl_ptr || !key || !key_hash_n(tbl_ptr, key, key_len, &h)) {
+    return NULL;
+  }
+  const node_t* node = find(tbl_ptr, key, key_len, h);
+  if (!node) {
+    return NULL;
+  }
+  if (data_len) {
+    *data_len = node->_data_len;
+  }
+  return dup_bytes(node->_data, node->_data_len);
+}
+
+const char*
+swiss_table_get_ref(const swiss_table_t* tbl_ptr, const char* key, size_t* data_len)
+{
+  if (!tbl_ptr || !key) {
+    return NULL;
+  }
+  size_t key_len = strlen(key);
+  const node_t* node = find(tbl_ptr, key, key_len, key_hash(tbl_ptr, key, key_len));
+  if (!node) {
+    return NULL;
+  }
+  if (data_len) {
+    *data_len = node->_data_len;
+  }
+  return node->_data;
+}
+
+const char*
+swiss_table_get_ref_n(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, size_t* data_len)
+{
+  uint64_t h;
+  if (!tbl_ptr || !key || !key_hash_n(tbl_ptr, key, key_len, &h)) {
+    return NULL;
+  }
+  const node_t* node = find(tbl_ptr, key, key_len, h);
+  if (!node) {
+    return NULL;
+  }
+  if (data_len) {
+    *data_len = node->_data_len;
+  }
+  return node->_data;
+}
+
+/*
+ * Hashes and prefetches one chunk of a batch before any of it is probed.
+ * hashed[i] is 0 for a NULL key or one whose hash needed memory that
+ * could not be allocated.
+ */
+static void
+batch_prepare(const swiss_table_t* tbl_ptr, const char* const* keys, const size_t* key_lens, size_t n, size_t* lens, uint64_t* hashes, uint8_t* hashed)
+{
+  for (size_t index = 0; index < n; ++index) {
+    lens[index] = 0;
+    hashes[index] = 0;
+    hashed[index] = 0;
+    if (!keys[index]) {
+      continue;
+    }
+    lens[index] = key_lens ? key_lens[index] : strlen(keys[index]);
+    if (key_lens) {
+      hashed[index] = key_hash_n(tbl_ptr, keys[index], lens[index], &hashes[index]);
+    } else {
+      hashes[index] = key_hash(tbl_ptr, keys[index], lens[index]);
+      hashed[index] = 1;
+    }
+  }
+  for (size_t index = 0; index < n; ++index) {
+    uint32_t pos = probe_start(tbl_ptr, hashes[index]);
+    __builtin_prefetch(tbl_ptr->_control + pos);
+    __builtin_prefetch(&tbl_ptr->_slots[pos]);
+  }
+}
+
+size_t
+swiss_table_get_batch(const swiss_table_t* tbl_ptr, const char* const* keys, const size_t* key_lens, size_t n, const char** values, size_t* data_lens)
+{
+  if (!tbl_ptr || (n && (!keys || !values))) {
+    return 0;
+  }
+  size_t found = 0;
+  size_t lens[BATCH_CHUNK];
+  uint64_t hashes[BATCH_CHUNK];
+  uint8_t hashed[BATCH_CHUNK];
+  for (size_t first = 0; first < n; first += BATCH_CHUNK) {
+    size_t count = n - first < BATCH_CHUNK ? n - first : BATCH_CHUNK;
+    batch_prepare(tbl_ptr, keys + first, key_lens ? key_lens + first : NULL, count, lens, hashes, hashed);
+    for (size_t index = 0; index < count; ++index) {
+      const node_t* node = hashed[index] ? find(tbl_ptr, keys[first + index], lens[index], hashes[index]) : NULL;
+      values[first + index] = node ? node->_data : NULL;
+      if (data_lens) {
+        data_lens[first + index] = node ? node->_data_len : 0;
+      }
+      found += node != NULL;
+    }
+  }
+  return found;
+}
+
+uint8_t
+swiss_table_insert_batch(swiss_table_t* tbl_ptr, const char* const* keys, const size_t* key_lens, const char* const* datas, const size_t* data_lens, size_t n, uint8_t* results)
+{
+  if (!tbl_ptr || (n && (!keys || !datas))) {
+    return INVALID_ARGS;
+  }
+  uint8_t err = NO_ERR;
+  size_t lens[BATCH_CHUNK];
+  uint64_t hashes[BATCH_CHUNK];
+  uint8_t hashed[BATCH_CHUNK];
+  for (size_t first = 0; first < n; first += BATCH_CHUNK) {
+    size_t count = n - first < BATCH_CHUNK ? n - first : BATCH_CHUNK;
+    batch_prepare(tbl_ptr, keys + first, key_lens ? key_lens + first : NULL, count, lens, hashes, hashed);
+    for (size_t index = 0; index < count; ++index) {
+      const char* data = datas[first + index];
+      size_t data_len = !data ? 0 : data_lens ? data_lens[first + index] : strlen(data);
+      uint8_t res = INVALID_ARGS;
+      if (keys[first + index] && data && lens[index] <= UINT32_MAX && data_len <= UINT32_MAX) {
+        res = hashed[index] ? insert_update(tbl_ptr, keys[first + index], lens[index], data, data_len, hashes[index]) : OUT_OF_MEMORY;
+      }
+      if (results) {
+        results[first + index] = res;
+      }
+      if (res != NO_ERR && res != UPDATED && err == NO_ERR) {
+        err = res;
+      }
+    }
+  }
+  return err;
+}
+
+void
+swiss_table_iter_init(swiss_table_iter_t* iter, const swiss_table_t* tbl_ptr)
+{
+  if (!iter) {
+    return;
+  }
+  iter->_tbl = tbl_ptr;
+  iter->_index = 0;
+  iter->_phase = tbl_ptr ? 0 : 2;
+}
+
+uint8_t
+swiss_table_iter_next(swiss_table_iter_t* iter, const char** key, size_t* key_len, const char** data, size_t* data_len)
+{
+  if (!iter) {
+    return 0;
+  }
+  while (iter->_phase < 2) {
+    const swiss_table_t* view = iter->_phase ? iter->_tbl->_old : iter->_tbl;
+    uint32_t index = view ? next_full(view, iter->_index) : 0;
+    if (view && index < capacity(view)) {
+      const node_t* node = &view->_slots[index];
+      iter->_index = index + 1;
+      if (key) {
+        *key = node_key(node);
+      }
+      if (key_len) {
+        *key_len = node->_key_len;
+      }
+      if (data) {
+        *data = node->_data;
+      }
+      if (data_len) {
+        *data_len = node->_data_len;
+      }
+      return 1;
+    }
+    /* Entries an incremental resize has not moved yet come last. */
+    iter->_phase = iter->_phase == 0 && iter->_tbl->_old ? 1 : 2;
+    iter->_index = 0;
+  }
+  return 0;
+}
+
+void
+swiss_table_foreach(const swiss_table_t* tbl_ptr, swiss_table_visit_f visit, void* ctx)
+{
+  if (!tbl_ptr || !visit) {
+    return;
+  }
+  swiss_table_iter_t iter;
+  const char* key;
+  const char* data;
+  size_t key_len, data_len;
+  swiss_table_iter_init(&iter, tbl_ptr);
+  while (swiss_table_iter_next(&iter, &key, &key_len, &data, &data_len)) {
+    visit(key, key_len, data, data_len, ctx);
+  }
+}
+
+/* Group an entry's probe starts in at the given group count. */
+static inline uint64_t
+home_group(uint64_t h, uint32_t group_count)
+{
+  return (h >> METADATA_BITS) / GROUP_SIZE & (group_count - 1);
+}
+
+/*
+ * Visits the entries of view whose probe starts in group bucket and whose
+ * home group at group_count is target. A live entry sits in the k-th
+ * window of its probe only if none of the earlier windows from its start
+ * slot held an EMPTY slot, so each of the group's start slots is followed
+ * until one of its windows does. Windows of consecutive start slots
+ * overlap, so one step reads the 2 * GROUP_SIZE - 1 slots covering all.
+ */
+static void
+scan_bucket(const swiss_table_t* view, uint32_t bucket, uint32_t group_count, uint64_t target, swiss_table_visit_f visit, void* ctx)
+{
+  uint32_t base = bucket * GROUP_SIZE;
+  uint32_t active = (1u << GROUP_SIZE) - 1;
+  for (uint32_t probe = 0, offset = 0; active && probe < view->_group_count; ++probe, offset += probe * GROUP_SIZE) {
+    uint32_t empty = 0;
+    for (uint32_t index = 0; index < 2 * GROUP_SIZE - 1; ++index) {
+      uint32_t pos = (base + offset + index) & slot_mask(view);
+      if (view->_control[pos] == EMPTY) {
+        empty |= 1u << index;
+      }
+      if ((int8_t)view->_control[pos] < 0) {
+        continue;
+      }
+      const node_t* node = &view->_slots[pos];
+      uint32_t start = probe_start(view, node->_hash) - base;
+      if (start < GROUP_SIZE && active >> start & 1 && index - start < GROUP_SIZE && home_group(node->_hash, group_count) == target) {
+        visit(node_key(node), node->_key_len, node->_data, node->_data_len, ctx);
+      }
+    }
+    for (uint32_t start = 0; start < GROUP_SIZE; ++start) {
+      if (empty >> start & ((1u << GROUP_SIZE) - 1)) {
+        active &= ~(1u << start);
+      }
+    }
+  }
+}
+
+static inline uint64_t
+reverse_bits(uint64_t value)
+{
+  value = (value >> 1 & 0x5555555555555555ull) | (value & 0x5555555555555555ull) << 1;
+  value = (value >> 2 & 0x3333333333333333ull) | (value & 0x3333333333333333ull) << 2;
+  value = (value >> 4 & 0x0f0f0f0f0f0f0f0full) | (value & 0x0f0f0f0f0f0f0f0full) << 4;
+  return __builtin_bswap64(value);
+}
+
+uint64_t
+swiss_table_scan(const swiss_table_t* tbl_ptr, uint64_t cursor, uint32_t count, swiss_table_visit_f visit, void* ctx)
+{
+  if (!tbl_ptr || !visit) {
+    return 0;
+  }
+  uint64_t mask = tbl_ptr->_group_count - 1;
+  if (!count) {
+    count = 1;
+  }
+  do {
+    uint64_t bucket = cursor & mask;
+    scan_bucket(tbl_ptr, bucket, tbl_ptr->_group_count, bucket, visit, ctx);
+    if (tbl_ptr->_old) {
+      scan_bucket(tbl_ptr->_old, bucket & (tbl_ptr->_old->_group_count - 1), tbl_ptr->_group_count, bucket, visit, ctx);
+    }
+    /* Increment the reversed cursor so buckets split by growth are not revisited. */
+    cursor |= ~mask;
+    cursor = reverse_bits(reverse_bits(cursor) + 1);
+  } while (cursor && --count);
+  return cursor;
+}
+
+uint8_t
+swiss_table_get_into(const swiss_table_t* tbl_ptr, const char* key, char* buf, size_t cap, size_t* data_len)
+{
+  if (!tbl_ptr || !key || (!buf && cap)) {
+    return INVALID_ARGS;
+  }
+  size_t key_len = strlen(key);
+  return copy_into(find(tbl_ptr, key, key_len, key_hash(tbl_ptr, key, key_len)), buf, cap, data_len);
+}
+
+uint8_t
+swiss_table_get_into_n(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, char* buf, size_t cap, size_t* data_len)
+{
+  if (!tbl_ptr || !key || (!buf && cap)) {
+    return INVALID_ARGS;
+  }
+  uint64_t h;
+  if (!key_hash_n(tbl_ptr, key, key_len, &h)) {
+    return OUT_OF_MEMORY;
+  }
+  return copy_into(find(tbl_ptr, key, key_len, h), buf, cap, data_len);
+}
+
+uint8_t
+swiss_table_reserve(swiss_table_t* tbl_ptr, size_t entries)
+{
+  if (!tbl_ptr) {
+    return INVALID_ARGS;
+  }
+  finish_migration(tbl_ptr);
+  if (entries < tbl_ptr->_current_size) {
+    entries = tbl_ptr->_current_size;
+  }
+  uint32_t group_count = group_count_for(entries, tbl_ptr->_max_load);
+  if (!group_count) {
+    return INVALID_ARGS;
+  }
+  if (group_count > tbl_ptr->_group_count && !resize(tbl_ptr, group_count)) {
+    return OUT_OF_MEMORY;
+  }
+  return NO_ERR;
+}
+
+uint8_t
+swiss_table_shrink_to_fit(swiss_table_t* tbl_ptr)
+{
+  if (!tbl_ptr) {
+    return INVALID_ARGS;
+  }
+  finish_migration(tbl_ptr);
+  uint32_t group_count = group_count_for(tbl_ptr->_current_size, tbl_ptr->_max_load);
+  if (group_count < tbl_ptr->_group_count) {
+    if (!resize(tbl_ptr, group_count)) {
+      return OUT_OF_MEMORY;
+    }
+  } else if (tbl_ptr->_deleted) {
+    drop_deleted(tbl_ptr);
+  }
+  return NO_ERR;
+}
+
+uint8_t
+swiss_table_compact(swiss_table_t* tbl_ptr)
+{
+  if (!tbl_ptr) {
+    return INVALID_ARGS;
+  }
+  finish_migration(tbl_ptr);
+  if (tbl_ptr->_deleted) {
+    drop_deleted(tbl_ptr);
+  }
+  return NO_ERR;
+}
+
+/* Bytes of key and value storage owned by view's entries. */
+static size_t
+string_bytes(const swiss_table_t* view)
+{
+  size_t bytes = 0;
+  for (uint32_t index = next_full(view, 0); index < capacity(view); index = next_full(view, index + 1)) {
+    const node_t* node = &view->_slots[index];
+    bytes += (size_t)node->_data_len + 1 + (node->_key_len >= INLINE_KEY_SIZE ? (size_t)node->_key_len + 1 : 0);
+  }
+  return bytes;
+}
+
+uint8_t
+swiss_table_get_stats(const swiss_table_t* tbl_ptr, swiss_table_stats_t* stats)
+{
+  if (!tbl_ptr || !stats) {
+    return INVALID_ARGS;
+  }
+  memset(stats, 0, sizeof(*stats));
+  const swiss_table_t* old = tbl_ptr->_old;
+  stats->size = tbl_ptr->_current_size;
+  stats->capacity = capacity(tbl_ptr);
+  stats->tombstones = tbl_ptr->_deleted;
+  stats->load_factor = (double)stats->size / stats->capacity;
+  stats->tombstone_ratio = (double)stats->tombstones / stats->capacity;
+  stats->resizes = tbl_ptr->_resizes;
+  stats->compactions = tbl_ptr->_compactions;
+  stats->rehash_ns = tbl_ptr->_rehash_ns;
+  stats->control_bytes = control_size(capacity(tbl_ptr)) + (old ? control_size(capacity(old)) : 0);
+  stats->slot_bytes = ((size_t)capacity(tbl_ptr) + (old ? capacity(old) : 0)) * sizeof(node_t);
+  if (tbl_ptr->_storage == SWISS_TABLE_STORAGE_ARENA) {
+    for (const arena_block_t* chunk = tbl_ptr->_arena._chunks; chunk; chunk = chunk->_next) {
+      stats->string_bytes += chunk->_size;
+    }
+    for (const arena_block_t* block = tbl_ptr->_arena._large; block; block = block->_next) {
+      stats->string_bytes += block->_size;
+    }
+  } else {
+    stats->string_bytes = string_bytes(tbl_ptr) + (old ? string_bytes(old) : 0);
+  }
+#if defined(SWISS_TABLE_STATS)
+  stats_counters_t counters = { { 0 }, 0, 0 };
+  merge_counters(&counters, &tbl_ptr->_counters);
+  if (old) {
+    merge_counters(&counters, &old->_counters);
+  }
+  stats->counters_enabled = 1;
+  memcpy(stats->probe_groups, counters._probe_groups, sizeof(stats->probe_groups));
+  stats->tag_hits = counters._tag_hits;
+  stats->tag_false_positives = counters._tag_false_positives;
+#endif
+  return NO_ERR;
+}
+
+void
+swiss_table_destroy(swiss_table_t* tbl_ptr)
+{
+  if (!tbl_ptr) {
+    return;
+  }
+  if (tbl_ptr->_storage == SWISS_TABLE_STORAGE_ARENA) {
+    arena_release(tbl_ptr);
+  } else {
+    for (uint32_t index = next_full(tbl_ptr, 0); index < capacity(tbl_ptr); index = next_full(tbl_ptr, index + 1)) {
+      node_release_key(tbl_ptr, &tbl_ptr->_slots[index]);
+      release_bytes(tbl_ptr, tbl_ptr->_slots[index]._data, tbl_ptr->_slots[index]._data_len);
+    }
+  }
+  if (tbl_ptr->_old) {
+    /* Release the undrained entries through the main table's storage. */
+    swiss_table_t* old = tbl_ptr->_old;
+    if (tbl_ptr->_storage != SWISS_TABLE_STORAGE_ARENA) {
+      for (uint32_t index = next_full(old, 0); index < capacity(old); index = next_full(old, index + 1)) {
+        node_release_key(tbl_ptr, &old->_slots[index]);
+        release_bytes(tbl_ptr, old->_slots[index]._data, old->_slots[index]._data_len);
+      }
+    }
+    free_arrays(tbl_ptr, old->_control, old->_slots, capacity(old));
+    tbl_free(tbl_ptr, old, sizeof(swiss_table_t));
+  }
+  free_arrays(tbl_ptr, tbl_ptr->_control, tbl_ptr->_slots, capacity(tbl_ptr));
+  tbl_free(tbl_ptr, tbl_ptr, sizeof(swiss_table_t));
+}
+
+#define SNAPSHOT_MAGIC 0x31425453495753ull /* "SWISTB1" */
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ALIGN 64
+
+/*
+ * Snapshot file, in native byte order: the header, the control bytes
+ * (clone tail included), one record per slot and the string heap. Records
+ * hold heap offsets instead of pointers and every key and value is
+ * NUL-terminated in the heap, so a read-only mapping is usable as is.
+ */
+typedef struct snapshot_header
+{
+  uint64_t _magic;
+  uint32_t _version;
+  uint32_t _group_count;
+  uint64_t _seed;
+  uint64_t _count;
+  uint64_t _control_offset;
+  uint64_t _slots_offset;
+  uint64_t _heap_offset;
+  uint64_t _heap_size;
+} snapshot_header_t;
+
+typedef struct snapshot_node
+{
+  uint64_t _key;
+  uint64_t _data;
+  uint32_t _key_len;
+  uint32_t _data_len;
+  uint64_t _hash;
+} snapshot_node_t;
+
+/*
+ * Read-only table served from a mapped snapshot. The embedded table
+ * header points into the mapping and supplies the seed, hash functions
+ * and probe geometry; it owns no memory.
+ */
+struct swiss_table_mapped
+{
+  swiss_table_t _table;
+  const snapshot_node_t* _slots;
+  const char* _heap;
+  uint64_t _heap_size;
+  void* _base;
+  size_t _size;
+};
+
+static inline uint64_t
+snapshot_align(uint64_t offset)
+{
+  return (offset + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+static uint8_t
+write_snapshot(const swiss_table_t* tbl_ptr, FILE* file)
+{
+  static const char zeros[SNAPSHOT_ALIGN] = { 0 };
+  snapshot_header_t header = { 0 };
+  header._magic = SNAPSHOT_MAGIC;
+  header._version = SNAPSHOT_VERSION;
+  header._group_count = tbl_ptr->_group_count;
+  header._seed = tbl_ptr->_seed;
+  header._count = tbl_ptr->_current_size;
+  header._control_offset = snapshot_align(sizeof(snapshot_header_t));
+  header._slots_offset = snapshot_align(header._control_offset + control_size(capacity(tbl_ptr)));
+  header._heap_offset = header._slots_offset + (uint64_t)capacity(tbl_ptr) * sizeof(snapshot_node_t);
+  for (uint32_t index = 0; index < capacity(tbl_ptr); ++index) {
+    if ((int8_t)tbl_ptr->_control[index] >= 0) {
+      header._heap_size += (uint64_t)tbl_ptr->_slots[index]._key_len + tbl_ptr->_slots[index]._data_len + 2;
+    }
+  }
+  uint8_t ok = fwrite(&header, sizeof(header), 1, file) == 1
+    && fwrite(zeros, 1, header._control_offset - sizeof(header), file) == header._control_offset - sizeof(header)
+    && fwrite(tbl_ptr->_control, 1, control_size(capacity(tbl_ptr)), file) == control_size(capacity(tbl_ptr))
+    && fwrite(zeros, 1, header._slots_offset - header._control_offset - control_size(capacity(tbl_ptr)), file)
+      == header._slots_offset - header._control_offset - control_size(capacity(tbl_ptr));
+  uint64_t heap_pos = 0;
+  for (uint32_t index = 0; ok && index < capacity(tbl_ptr); ++index) {
+    snapshot_node_t record = { 0 };
+    if ((int8_t)tbl_ptr->_control[index] >= 0) {
+      const node_t* node = &tbl_ptr->_slots[index];
+      record._key = heap_pos;
+      record._data = heap_pos + node->_key_len + 1;
+      record._key_len = node->_key_len;
+      record._data_len = node->_data_len;
+      record._hash = node->_hash;
+      heap_pos = record._data + node->_data_len + 1;
+    }
+    ok = fwrite(&record, sizeof(record), 1, file) == 1;
+  }
+  for (uint32_t index = 0; ok && index < capacity(tbl_ptr); ++index) {
+    if ((int8_t)tbl_ptr->_control[index] >= 0) {
+      const node_t* node = &tbl_ptr->_slots[index];
+      ok = fwrite(node_key(node), 1, node->_key_len + 1, file) == node->_key_len + 1
+        && fwrite(node->_data, 1, node->_data_len + 1, file) == node->_data_len + 1;
+    }
+  }
+  return ok;
+}
+
+uint8_t
+swiss_table_save(swiss_table_t* tbl_ptr, const char* path)
+{
+  if (!tbl_ptr || !path) {
+    return INVALID_ARGS;
+  }
+  finish_migration(tbl_ptr);
+  /*
+   * Written to a uniquely named file next to path, synced and renamed over
+   * it, so readers never map a partial file and concurrent saves to the
+   * same path never share a temporary.
+   */
+#if defined(__unix__) || defined(__APPLE__)
+  static const char suffix[] = ".XXXXXX";
+#else
+  static const char suffix[] = ".tmp";
+#endif
+  size_t path_len = strlen(path);
+  char* tmp_path = (char*)malloc(path_len + sizeof(suffix));
+  if (!tmp_path) {
+    return OUT_OF_MEMORY;
+  }
+  memcpy(tmp_path, path, path_len);
+  memcpy(tmp_path + path_len, suffix, sizeof(suffix));
+#if defined(__unix__) || defined(__APPLE__)
+  int fd = mkstemp(tmp_path);
+  FILE* file = fd < 0 ? NULL : fdopen(fd, "wb");
+  if (!file) {
+    if (fd >= 0) {
+      close(fd);
+      remove(tmp_path);
+    }
+    free(tmp_path);
+    return IO_ERROR;
+  }
+#else
+  FILE* file = fopen(tmp_path, "wb");
+  if (!file) {
+    free(tmp_path);
+    return IO_ERROR;
+  }
+#endif
+  uint8_t ok = write_snapshot(tbl_ptr, file);
+#if defined(__unix__) || defined(__APPLE__)
+  ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif
+  ok = fclose(file) == 0 && ok;
+  ok = ok && rename(tmp_path, path) == 0;
+  if (!ok) {
+    remove(tmp_path);
+  }
+  free(tmp_path);
+  return ok ? NO_ERR : IO_ERROR;
+}
+
+static uint8_t
+snapshot_valid(const snapshot_header_t* header, size_t size)
+{
+  if (header->_magic != SNAPSHOT_MAGIC || header->_version != SNAPSHOT_VERSION) {
+    return 0;
+  }
+  uint32_t group_count = header->_group_count;
+  if (!group_count || group_count > MAX_GROUP_COUNT || (group_count & (group_count - 1))) {
+    return 0;
+  }
+  /* Offsets come from the file; compare differences so no sum can wrap. */
+  uint64_t slot_count = (uint64_t)group_count * GROUP_SIZE;
+  return header->_count < slot_count
+    && header->_control_offset >= sizeof(snapshot_header_t)
+    && header->_control_offset <= header->_slots_offset
+    && control_size(slot_count) <= header->_slots_offset - header->_control_offset
+    && header->_slots_offset <= header->_heap_offset
+    && header->_heap_offset - header->_slots_offset == slot_count * sizeof(snapshot_node_t)
+    && header->_heap_offset <= size
+    && header->_heap_size == size - header->_heap_offset;
+}
+
+swiss_table_mapped_t*
+swiss_table_open_mmap(const char* path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+  if (!path) {
+    return NULL;
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) || (uint64_t)file_stat.st_size < sizeof(snapshot_header_t) || (uint64_t)file_stat.st_size > SIZE_MAX) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = file_stat.st_size;
+  void* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+  const snapshot_header_t* header = (const snapshot_header_t*)base;
+  swiss_table_mapped_t* mapped = snapshot_valid(header, size) ? (swiss_table_mapped_t*)calloc(1, sizeof(swiss_table_mapped_t)) : NULL;
+  if (!mapped) {
+    munmap(base, size);
+    return NULL;
+  }
+  mapped->_table._control = (uint8_t*)base + header->_control_offset;
+  mapped->_table._group_count = header->_group_count;
+  mapped->_table._current_size = header->_count;
+  mapped->_table._seed = header->_seed;
+  mapped->_table._backend = select_backend(SWISS_TABLE_BACKEND_AUTO);
+  mapped->_slots = (const snapshot_node_t*)((const char*)base + header->_slots_offset);
+  mapped->_heap = (const char*)base + header->_heap_offset;
+  mapped->_heap_size = header->_heap_size;
+  mapped->_base = base;
+  mapped->_size = size;
+  return mapped;
+#else
+  (void)path;
+  return NULL;
+#endif
+}
+
+void
+swiss_table_mapped_set_hash(swiss_table_mapped_t* mapped, uint64_t (*hash_f)(const char*))
+{
+  if (mapped) {
+    mapped->_table.hash_f = hash_f;
+  }
+}
+
+void
+swiss_table_mapped_set_hash_n(swiss_table_mapped_t* mapped, uint64_t (*hash_n_f)(const char*, size_t))
+{
+  if (mapped) {
+    mapped->_table.hash_n_f = hash_n_f;
+  }
+}
+
+/* Offsets come from the file, so they are bounds-checked before use. */
+static inline uint8_t
+mapped_node_has_key(const swiss_table_mapped_t* mapped, const snapshot_node_t* node, const char* key, size_t key_len, uint64_t h)
+{
+  return node->_hash == h && node->_key_len == key_len && node->_key < mapped->_heap_size
+    && key_len < mapped->_heap_size - node->_key && !memcmp(mapped->_heap + node->_key, key, key_len);
+}
+
+typedef struct mapped_probe
+{
+  const swiss_table_mapped_t* _mapped;
+  const char* _key;
+  size_t _key_len;
+  uint64_t _hash;
+} mapped_probe_t;
+
+static uint8_t
+mapped_slot_match(const void* ctx, uint32_t index)
+{
+  const mapped_probe_t* probe = (const mapped_probe_t*)ctx;
+  return mapped_node_has_key(probe->_mapped, &probe->_mapped->_slots[index], probe->_key, probe->_key_len, probe->_hash);
+}
+
+/* Probes at most every group once, so a damaged file cannot loop forever. */
+static const snapshot_node_t*
+mapped_find(const swiss_table_mapped_t* mapped, const char* key, size_t key_len, uint64_t h)
+{
+  const swiss_table_t* tbl_ptr = &mapped->_table;
+  mapped_probe_t probe = { mapped, key, key_len, h };
+  uint32_t index = tbl_ptr->_backend->find_match(tbl_ptr, h, tbl_ptr->_group_count, &mapped_slot_match, &probe, NULL);
+  return index == UINT32_MAX ? NULL : &mapped->_slots[index];
+}
+
+static const char*
+mapped_get(const swiss_table_mapped_t* mapped, const char* key, size_t key_len, uint64_t h, size_t* data_len)
+{
+  const snapshot_node_t* node = mapped_find(mapped, key, key_len, h);
+  if (!node || node->_data >= mapped->_heap_size || node->_data_len >= mapped->_heap_size - node->_data) {
+    return NULL;
+  }
+  if (data_len) {
+    *data_len = node->_data_len;
+  }
+  return mapped->_heap + node->_data;
+}
+
+const char*
+swiss_table_mapped_get_ref(const swiss_table_mapped_t* mapped, const char* key, size_t* data_len)
+{
+  if (!mapped || !key) {
+    return NULL;
+  }
+  size_t key_len = strlen(key);
+  if (key_len > UINT32_MAX) {
+    return NULL;
+  }
+  return mapped_get(mapped, key, key_len, key_hash(&mapped->_table, key, key_len), data_len);
+}
+
+const char*
+swiss_table_mapped_get_ref_n(const swiss_table_mapped_t* mapped, const char* key, size_t key_len, size_t* data_len)
+{
+  uint64_t h;
+  if (!mapped || !key || key_len > UINT32_MAX || !key_hash_n(&mapped->_table, key, key_len, &h)) {
+    return NULL;
+  }
+  return mapped_get(mapped, key, key_len, h, data_len);
+}
+
+size_t
+swiss_table_mapped_size(const swiss_table_mapped_t* mapped)
+{
+  return mapped ? mapped->_table._current_size : 0;
+}
+
+void
+swiss_table_mapped_close(swiss_table_mapped_t* mapped)
+{
+  if (!mapped) {
+    return;
+  }
+#if defined(__unix__) || defined(__APPLE__)
+  munmap(mapped->_base, mapped->_size);
+#endif
+  free(mapped);
+}
+
+#define STREAM_MAGIC 0x31535453495753ull /* "SWISTS1" */
+#define STREAM_VERSION 2
+/* Target payload per block; a larger entry gets a block of its own. */
+#define STREAM_BLOCK_SIZE (64 * 1024)
+#define STREAM_HEADER_SIZE 28
+#define BLOCK_HEADER_SIZE 20
+#define ENTRY_HEADER_SIZE 8
+#define ENTRY_MAX_SIZE (ENTRY_HEADER_SIZE + 2 * (uint64_t)UINT32_MAX)
+
+/*
+ * Stream format, little-endian. Header: magic (8), version (4), zero (4),
+ * entry count (8), CRC32C of the preceding 24 bytes (4). Then blocks of
+ * payload length (8), entry count (4), CRC32C of those 12 bytes (4) and
+ * CRC32C of the payload (4), followed by the payload: per entry key
+ * length (4), value length (4), key bytes, value bytes. An empty block
+ * ends the stream. Entries are written in slot (group) order.
+ */
+#if !defined(__SSE4_2__)
+/* CRC32C of each 4-bit value, for the table-driven fallback. */
+static const uint32_t crc32c_nibbles[16] = {
+  0x00000000, 0x105ec76f, 0x20bd8ede, 0x30e349b1, 0x417b1dbc, 0x5125dad3, 0x61c69362, 0x7198540d,
+  0x82f63b78, 0x92a8fc17, 0xa24bb5a6, 0xb21572c9, 0xc38d26c4, 0xd3d3e1ab, 0xe330a81a, 0xf36e6f75
+};
+#endif
+
+/* CRC32C (Castagnoli) of len bytes, continuing from crc (0 to start). */
+static uint32_t
+crc32c(uint32_t crc, const void* buf, size_t len)
+{
+  const uint8_t* bytes = (const uint8_t*)buf;
+  crc = ~crc;
+#if defined(__SSE4_2__)
+  for (; len >= sizeof(uint64_t); bytes += sizeof(uint64_t), len -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    crc = (uint32_t)_mm_crc32_u64(crc, word);
+  }
+  for (; len; ++bytes, --len) {
+    crc = _mm_crc32_u8(crc, *bytes);
+  }
+#else
+  for (; len; ++bytes, --len) {
+    crc = (crc >> 4) ^ crc32c_nibbles[(crc ^ *bytes) & 0xf];
+    crc = (crc >> 4) ^ crc32c_nibbles[(crc ^ (*bytes >> 4)) & 0xf];
+  }
+#endif
+  return ~crc;
+}
+
+static inline void
+store_le(uint8_t* dst, uint64_t value, size_t size)
+{
+  for (size_t index = 0; index < size; ++index) {
+    dst[index] = (uint8_t)(value >> (8 * index));
+  }
+}
+
+static inline uint64_t
+load_le(const uint8_t* src, size_t size)
+{
+  uint64_t value = 0;
+  for (size_t index = 0; index < size; ++index) {
+    value |= (uint64_t)src[index] << (8 * index);
+  }
+  return value;
+}
+
+/* Writes one block whose payload is the concatenation of parts. */
+static uint8_t
+write_block(swiss_table_write_f write, void* ctx, uint32_t entries, const void* const* parts, const size_t* lens, size_t part_count)
+{
+  uint8_t header[BLOCK_HEADER_SIZE];
+  uint64_t payload_len = 0;
+  for (size_t part = 0; part < part_count; ++part) {
+    payload_len += lens[part];
+  }
+  store_le(header, payload_len, 8);
+  store_le(header + 8, entries, 4);
+  store_le(header + 12, crc32c(0, header, 12), 4);
+  uint32_t crc = 0;
+  for (size_t part = 0; part < part_count; ++part) {
+    crc = crc32c(crc, parts[part], lens[part]);
+  }
+  store_le(header + 16, crc, 4);
+  if (write(ctx, header, sizeof(header)) != sizeof(header)) {
+    return 0;
+  }
+  for (size_t part = 0; part < part_count; ++part) {
+    if (lens[part] && write(ctx, parts[part], lens[part]) != lens[part]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+uint8_t
+swiss_table_write_stream(swiss_table_t* tbl_ptr, swiss_table_write_f write, void* ctx)
+{
+  if (!tbl_ptr || !write) {
+    return INVALID_ARGS;
+  }
+  finish_migration(tbl_ptr);
+  uint8_t header[STREAM_HEADER_SIZE] = { 0 };
+  store_le(header, STREAM_MAGIC, 8);
+  store_le(header + 8, STREAM_VERSION, 4);
+  store_le(header + 16, tbl_ptr->_current_size, 8);
+  store_le(header + 24, crc32c(0, header, 24), 4);
+  if (write(ctx, header, sizeof(header)) != sizeof(header)) {
+    return IO_ERROR;
+  }
+  uint8_t* block = (uint8_t*)tbl_alloc(tbl_ptr, STREAM_BLOCK_SIZE, 1);
+  if (!block) {
+    return OUT_OF_MEMORY;
+  }
+  uint8_t ok = 1;
+  size_t used = 0;
+  uint32_t entries = 0;
+  for (uint32_t index = 0; ok && index < capacity(tbl_ptr); ++index) {
+    if ((int8_t)tbl_ptr->_control[index] < 0) {
+      continue;
+    }
+    const node_t* node = &tbl_ptr->_slots[index];
+    uint64_t entry_size = ENTRY_HEADER_SIZE + (uint64_t)node->_key_len + node->_data_len;
+    if (used && used + entry_size > STREAM_BLOCK_SIZE) {
+      const void* parts[1] = { block };
+      ok = write_block(write, ctx, entries, parts, &used, 1);
+      used = 0;
+      entries = 0;
+    }
+    uint8_t entry_header[ENTRY_HEADER_SIZE];
+    store_le(entry_header, node->_key_len, 4);
+    store_le(entry_header + 4, node->_data_len, 4);
+    if (entry_size > STREAM_BLOCK_SIZE) {
+      const void* parts[3] = { entry_header, node_key(node), node->_data };
+      const size_t lens[3] = { ENTRY_HEADER_SIZE, node->_key_len, node->_data_len };
+      ok = ok && write_block(write, ctx, 1, parts, lens, 3);
+      continue;
+    }
+    memcpy(block + used, entry_header, ENTRY_HEADER_SIZE);
+    memcpy(block + used + ENTRY_HEADER_SIZE, node_key(node), node->_key_len);
+    memcpy(block + used + ENTRY_HEADER_SIZE + node->_key_len, node->_data, node->_data_len);
+    used += entry_size;
+    ++entries;
+  }
+  if (ok && used) {
+    const void* parts[1] = { block };
+    ok = write_block(write, ctx, entries, parts, &used, 1);
+  }
+  tbl_free(tbl_ptr, block, STREAM_BLOCK_SIZE);
+  return ok && write_block(write, ctx, 0, NULL, NULL, 0) ? NO_ERR : IO_ERROR;
+}
+
+/* 1 if exactly len bytes were read. */
+static uint8_t
+read_exact(swiss_table_read_f read, void* ctx, void* buf, size_t len)
+{
+  for (size_t done = 0, res; done < len; done += res) {
+    res = read(ctx, (char*)buf + done, len - done);
+    if (!res) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Inserts the entries of a verified payload; CORRUPT_DATA if they do not fill it exactly. */
+static uint8_t
+load_block(swiss_table_t* tbl_ptr, const uint8_t* payload, uint64_t payload_len, uint32_t entries)
+{
+  uint64_t pos = 0;
+  for (uint32_t entry = 0; entry < entries; ++entry) {
+    if (payload_len - pos < ENTRY_HEADER_SIZE) {
+      return CORRUPT_DATA;
+    }
+    uint64_t key_len = load_le(payload + pos, 4);
+    uint64_t data_len = load_le(payload + pos + 4, 4);
+    pos += ENTRY_HEADER_SIZE;
+    if (payload_len - pos < key_len + data_len) {
+      return CORRUPT_DATA;
+    }
+    uint8_t res = swiss_table_insert_update_n(tbl_ptr, (const char*)payload + pos, key_len, (const char*)payload + pos + key_len, data_len);
+    if (res != NO_ERR && res != UPDATED) {
+      return res;
+    }
+    pos += key_len + data_len;
+  }
+  return pos == payload_len ? NO_ERR : CORRUPT_DATA;
+}
+
+uint8_t
+swiss_table_read_stream(swiss_table_t* tbl_ptr, swiss_table_read_f read, void* ctx)
+{
+  if (!tbl_ptr || !read) {
+    return INVALID_ARGS;
+  }
+  uint8_t header[STREAM_HEADER_SIZE];
+  if (!read_exact(read, ctx, header, sizeof(header))) {
+    return IO_ERROR;
+  }
+  if (load_le(header, 8) != STREAM_MAGIC || load_le(header + 8, 4) != STREAM_VERSION || load_le(header + 24, 4) != crc32c(0, header, 24)) {
+    return CORRUPT_DATA;
+  }
+  uint64_t count = load_le(header + 16, 8);
+  if (count > UINT32_MAX || swiss_table_reserve(tbl_ptr, (size_t)tbl_ptr->_current_size + count) != NO_ERR) {
+    return count > UINT32_MAX ? CORRUPT_DATA : OUT_OF_MEMORY;
+  }
+  uint8_t* payload = NULL;
+  uint64_t payload_cap = 0;
+  uint64_t loaded = 0;
+  uint8_t res = NO_ERR;
+  for (;;) {
+    uint8_t block_header[BLOCK_HEADER_SIZE];
+    if (!read_exact(read, ctx, block_header, sizeof(block_header))) {
+      res = IO_ERROR;
+      break;
+    }
+    /* The length is trusted only once its own CRC matches, before anything is allocated for it. */
+    if (load_le(block_header + 12, 4) != crc32c(0, block_header, 12)) {
+      res = CORRUPT_DATA;
+      break;
+    }
+    uint64_t payload_len = load_le(block_header, 8);
+    uint32_t entries = load_le(block_header + 8, 4);
+    if (!entries) {
+      res = payload_len || loaded != count || load_le(block_header + 16, 4) ? CORRUPT_DATA : NO_ERR;
+      break;
+    }
+    if (payload_len < (uint64_t)entries * ENTRY_HEADER_SIZE || (payload_len > STREAM_BLOCK_SIZE && (entries != 1 || payload_len > ENTRY_MAX_SIZE))
+        || count - loaded < entries || payload_len > SIZE_MAX) {
+      res = CORRUPT_DATA;
+      break;
+    }
+    if (payload_len > payload_cap) {
+      /* The allocator has no realloc, and the old contents are already loaded. */
+      uint64_t new_cap = payload_len > STREAM_BLOCK_SIZE ? payload_len : STREAM_BLOCK_SIZE;
+      tbl_free(tbl_ptr, payload, payload_cap);
+      payload = (uint8_t*)tbl_alloc(tbl_ptr, new_cap, 1);
+      payload_cap = payload ? new_cap : 0;
+      if (!payload) {
+        res = OUT_OF_MEMORY;
+        break;
+      }
+    }
+    if (!read_exact(read, ctx, payload, payload_len)) {
+      res = IO_ERROR;
+      break;
+    }
+    if (load_le(block_header + 16, 4) != crc32c(0, payload, payload_len)) {
+      res = CORRUPT_DATA;
+      break;
+    }
+    res = load_block(tbl_ptr, payload, payload_len, entries);
+    if (res != NO_ERR) {
+      break;
+    }
+    loaded += entries;
+  }
+  tbl_free(tbl_ptr, payload, payload_cap);
+  return res;
+}
+
+/*
+ * Key-only set. The embedded table header supplies the control bytes,
+ * sizes, seed, allocator and key storage; its _slots stay NULL and keys
+ * live in _keys at 16 bytes per slot. Only the high half of each hash is
+ * kept to confirm matches, so resizing hashes the keys again.
+ */
+typedef struct swiss_set_node
+{
+  char* _key;
+  uint32_t _key_len;
+  uint32_t _hash_high;
+} set_node_t;
+
+struct swiss_set
+{
+  swiss_table_t _table;
+  set_node_t* _keys;
+};
+
+static inline uint8_t
+set_node_has_key(const set_node_t* node, const char* key, size_t key_len, uint64_t h)
+{
+  return node->_hash_high == (uint32_t)(h >> 32) && node->_key_len == key_len && !memcmp(node->_key, key, key_len);
+}
+
+/* Moves every key into fresh arrays of group_count groups; 0 if allocation fails. */
+static uint8_t
+set_resize(swiss_set_t* set_ptr, uint32_t group_count)
+{
+  swiss_table_t* tbl_ptr = &set_ptr->_table;
+  uint32_t old_capacity = capacity(tbl_ptr);
+  uint32_t new_capacity = group_count * GROUP_SIZE;
+  uint8_t* control = (uint8_t*)tbl_alloc(tbl_ptr, control_size(new_capacity), GROUP_SIZE);
+  set_node_t* keys = (set_node_t*)tbl_alloc(tbl_ptr, (size_t)new_capacity * sizeof(set_node_t), _Alignof(set_node_t));
+  if (!control || !keys) {
+    tbl_free(tbl_ptr, control, control_size(new_capacity));
+    tbl_free(tbl_ptr, keys, (size_t)new_capacity * sizeof(set_node_t));
+    return 0;
+  }
+  memset(control, EMPTY, control_size(new_capacity));
+  uint8_t* old_control = tbl_ptr->_control;
+  set_node_t* old_keys = set_ptr->_keys;
+  tbl_ptr->_control = control;
+  tbl_ptr->_group_count = group_count;
+  tbl_ptr->_deleted = 0;
+  set_ptr->_keys = keys;
+  for (uint32_t old_index = 0; old_index < old_capacity; ++old_index) {
+    if ((int8_t)old_control[old_index] >= 0) {
+      const set_node_t* node = &old_keys[old_index];
+      uint64_t h = key_hash(tbl_ptr, node->_key, node->_key_len);
+      uint32_t index = find_free_slot(tbl_ptr, h);
+      set_control(tbl_ptr, index, h & METADATA_MASK);
+      keys[index] = *node;
+    }
+  }
+  tbl_free(tbl_ptr, old_control, control_size(old_capacity));
+  tbl_free(tbl_ptr, old_keys, (size_t)old_capacity * sizeof(set_node_t));
+  return 1;
+}
+
+typedef struct set_probe
+{
+  const swiss_set_t* _set;
+  const char* _key;
+  size_t _key_len;
+  uint64_t _hash;
+} set_probe_t;
+
+static uint8_t
+set_slot_match(const void* ctx, uint32_t index)
+{
+  const set_probe_t* probe = (const set_probe_t*)ctx;
+  return set_node_has_key(&probe->_set->_keys[index], probe->_key, probe->_key_len, probe->_hash);
+}
+
+/*
+ * Slot holding key, UINT32_MAX if absent. With free_slot, the same probe
+ * also yields the slot an absent key would go to.
+ */
+static uint32_t
+set_find(const swiss_set_t* set_ptr, const char* key, size_t key_len, uint64_t h, uint32_t* free_slot)
+{
+  const swiss_table_t* tbl_ptr = &set_ptr->_table;
+  set_probe_t probe = { set_ptr, key, key_len, h };
+  return tbl_ptr->_backend->find_match(tbl_ptr, h, tbl_ptr->_group_count, &set_slot_match, &probe, free_slot);
+}
+
+/* The set header is the first member, so the table pointer is the set's. */
+static uint64_t
+set_hash_at(const swiss_table_t* tbl_ptr, uint32_t index)
+{
+  const set_node_t* node = &((const swiss_set_t*)tbl_ptr)->_keys[index];
+  return key_hash(tbl_ptr, node->_key, node->_key_len);
+}
+
+static void
+set_move(swiss_table_t* tbl_ptr, uint32_t to, uint32_t from)
+{
+  set_node_t* keys = ((swiss_set_t*)tbl_ptr)->_keys;
+  keys[to] = keys[from];
+}
+
+static void
+set_swap(swiss_table_t* tbl_ptr, uint32_t lhs, uint32_t rhs)
+{
+  set_node_t* keys = ((swiss_set_t*)tbl_ptr)->_keys;
+  set_node_t tmp = keys[lhs];
+  keys[lhs] = keys[rhs];
+  keys[rhs] = tmp;
+}
+
+static const slot_array_t set_array = { &set_hash_at, &set_move, &set_swap };
+
+/* make_room for a set: grow, or drop tombstones in place; 0 if still over the limit. */
+static uint8_t
+set_make_room(swiss_set_t* set_ptr)
+{
+  swiss_table_t* tbl_ptr = &set_ptr->_table;
+  if (tbl_ptr->_current_size <= growth_limit(tbl_ptr) / 2 || tbl_ptr->_group_count == MAX_GROUP_COUNT
+      || !set_resize(set_ptr, tbl_ptr->_group_count * 2)) {
+    rehash_in_place(tbl_ptr, &set_array);
+  }
+  return tbl_ptr->_current_size + tbl_ptr->_deleted <= growth_limit(tbl_ptr);
+}
+
+static uint8_t
+set_insert(swiss_set_t* set_ptr, const char* key, size_t key_len, uint64_t h)
+{
+  swiss_table_t* tbl_ptr = &set_ptr->_table;
+  uint32_t index;
+  if (set_find(set_ptr, key, key_len, h, &index) != UINT32_MAX) {
+    return UPDATED;
+  }
+  if (tbl_ptr->_current_size + tbl_ptr->_deleted > growth_limit(tbl_ptr)) {
+    if (!set_make_room(set_ptr)) {
+      return OUT_OF_MEMORY;
+    }
+    index = find_free_slot(tbl_ptr, h);
+  }
+  char* stored = store_bytes(tbl_ptr, key, key_len);
+  if (!stored) {
+    return OUT_OF_MEMORY;
+  }
+  if (tbl_ptr->_control[index] == DELETED) {
+    --tbl_ptr->_deleted;
+  }
+  set_control(tbl_ptr, index, h & METADATA_MASK);
+  set_ptr->_keys[index]._key = stored;
+  set_ptr->_keys[index]._key_len = key_len;
+  set_ptr->_keys[index]._hash_high = h >> 32;
+  ++tbl_ptr->_current_size;
+  return NO_ERR;
+}
+
+static uint8_t
+set_erase(swiss_set_t* set_ptr, const char* key, size_t key_len, uint64_t h)
+{
+  swiss_table_t* tbl_ptr = &set_ptr->_table;
+  uint32_t index = set_find(set_ptr, key, key_len, h, NULL);
+  if (index == UINT32_MAX) {
+    return KEY_NOT_FOUND;
+  }
+  release_bytes(tbl_ptr, set_ptr->_keys[index]._key, set_ptr->_keys[index]._key_len);
+  if (tbl_ptr->_backend->was_never_full(tbl_ptr, index)) {
+    set_control(tbl_ptr, index, EMPTY);
+  } else {
+    set_control(tbl_ptr, index, DELETED);
+    ++tbl_ptr->_deleted;
+  }
+  --tbl_ptr->_current_size;
+  return NO_ERR;
+}
+
+swiss_set_t*
+swiss_set_init_opts(const swiss_table_options_t* opts)
+{
+  swiss_table_t header;
+  if (!apply_options(&header, opts)) {
+    return NULL;
+  }
+  swiss_set_t* new_set = (swiss_set_t*)tbl_alloc(&header, sizeof(swiss_set_t), _Alignof(swiss_set_t));
+  if (!new_set) {
+    return NULL;
+  }
+  uint32_t group_count = header._group_count;
+  /* No arrays yet: set_resize starts from an empty one. */
+  header._group_count = 0;
+  header._incremental = 0;
+  new_set->_table = header;
+  new_set->_keys = NULL;
+  new_set->_table._seed = hash_seed(new_set);
+  if (!set_resize(new_set, group_count)) {
+    tbl_free(&header, new_set, sizeof(swiss_set_t));
+    return NULL;
+  }
+  return new_set;
+}
+
+swiss_set_t*
+swiss_set_init(void)
+{
+  return swiss_set_init_opts(NULL);
+}
+
+uint8_t
+swiss_set_insert(swiss_set_t* set_ptr, const char* key)
+{
+  if (!set_ptr || !key) {
+    return INVALID_ARGS;
+  }
+  return swiss_set_insert_n(set_ptr, key, strlen(key));
+}
+
+uint8_t
+swiss_set_insert_n(swiss_set_t* set_ptr, const char* key, size_t key_len)
+{
+  if (!set_ptr || !key || key_len > UINT32_MAX) {
+    return INVALID_ARGS;
+  }
+  return set_insert(set_ptr, key, key_len, key_hash(&set_ptr->_table, key, key_len));
+}
+
+uint8_t
+swiss_set_contains(const swiss_set_t* set_ptr, const char* key)
+{
+  return key && swiss_set_contains_n(set_ptr, key, strlen(key));
+}
+
+uint8_t
+swiss_set_contains_n(const swiss_set_t* set_ptr, const char* key, size_t key_len)
+{
+  if (!set_ptr || !key || key_len > UINT32_MAX) {
+    return 0;
+  }
+  return set_find(set_ptr, key, key_len, key_hash(&set_ptr->_table, key, key_len), NULL) != UINT32_MAX;
+}
+
+uint8_t
+swiss_set_erase(swiss_set_t* set_ptr, const char* key)
+{
+  if (!set_ptr || !key) {
+    return INVALID_ARGS;
+  }
+  return swiss_set_erase_n(set_ptr, key, strlen(key));
+}
+
+uint8_t
+swiss_set_erase_n(swiss_set_t* set_ptr, const char* key, size_t key_len)
+{
+  if (!set_ptr || !key || key_len > UINT32_MAX) {
+    return INVALID_ARGS;
+  }
+  return set_erase(set_ptr, key, key_len, key_hash(&set_ptr->_table, key, key_len));
+}
+
+size_t
+swiss_set_size(const swiss_set_t* set_ptr)
+{
+  return set_ptr ? set_ptr->_table._current_size : 0;
+}
+
+void
+swiss_set_destroy(swiss_set_t* set_ptr)
+{
+  if (!set_ptr) {
+    return;
+  }
+  swiss_table_t* tbl_ptr = &set_ptr->_table;
+  if (tbl_ptr->_storage == SWISS_TABLE_STORAGE_ARENA) {
+    arena_release(tbl_ptr);
+  } else {
+    for (uint32_t index = 0; index < capacity(tbl_ptr); ++index) {
+      if ((int8_t)tbl_ptr->_control[index] >= 0) {
+        release_bytes(tbl_ptr, set_ptr->_keys[index]._key, set_ptr->_keys[index]._key_len);
+      }
+    }
+  }
+  tbl_free(tbl_ptr, tbl_ptr->_control, control_size(capacity(tbl_ptr)));
+  tbl_free(tbl_ptr, set_ptr->_keys, (size_t)capacity(tbl_ptr) * sizeof(set_node_t));
+  tbl_free(tbl_ptr, set_ptr, sizeof(swiss_set_t));
+}
@@ -1,28 +1,338 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
 typedef struct swiss_table_node node_t;
 typedef struct swiss_table swiss_table_t;
+typedef struct swiss_set swiss_set_t;
+typedef struct swiss_table_mapped swiss_table_mapped_t;
 
 enum errors
 {
   NO_ERR = 0,
   UPDATED,
   KEY_NOT_FOUND,
-  INVALID_ARGS
+  INVALID_ARGS,
+  BUFFER_TOO_SMALL,
+  OUT_OF_MEMORY,
+  IO_ERROR,
+  CORRUPT_DATA
 };
 
+/*
+ * Memory used by a table (arrays and, by default, key/value bytes) goes
+ * through this interface. free receives the size that was requested.
+ */
+typedef struct swiss_table_allocator
+{
+  void* (*alloc)(void* ctx, size_t size, size_t align);
+  void (*free)(void* ctx, void* ptr, size_t size);
+  void* ctx;
+} swiss_table_allocator_t;
+
+enum swiss_table_storage
+{
+  /* One allocator call per stored key and value. */
+  SWISS_TABLE_STORAGE_HEAP = 0,
+  /*
+   * Keys and values are carved from table-owned chunks with size-class
+   * free lists; destroy releases the chunks in bulk.
+   */
+  SWISS_TABLE_STORAGE_ARENA
+};
+
+/*
+ * Probe implementation of a table. All backends share the table layout,
+ * hash, resize and memory management and differ only in how a group of
+ * control bytes is searched, so tables using different backends can live
+ * in one process.
+ */
+enum swiss_table_backend_id
+{
+  /*
+   * The SWISS_TABLE_BACKEND environment variable ("cons", "simd" or
+   * "parallel") if set, otherwise simd when the CPU supports its vector
+   * kernel and cons if not.
+   */
+  SWISS_TABLE_BACKEND_AUTO = 0,
+  /* Plain per-byte loops. */
+  SWISS_TABLE_BACKEND_CONS,
+  /* SSE2/NEON (SWAR fallback) bitmask matching of a whole group. */
+  SWISS_TABLE_BACKEND_SIMD,
+  /* OpenMP simd matching; rehashing and bulk builds use all OpenMP threads. */
+  SWISS_TABLE_BACKEND_PARALLEL
+};
+
+/* Zero-initialised options select the defaults. */
+typedef struct swiss_table_options
+{
+  uint8_t storage;
+  swiss_table_allocator_t allocator; /* alloc == NULL selects malloc/free */
+  size_t capacity; /* entries to hold without rehashing */
+  float max_load; /* fill limit in (0, 0.875], 0 selects 0.7 */
+  /*
+   * Nonzero: growing allocates the doubled arrays but moves entries a few
+   * groups at a time on later inserts and deletes, bounding the cost of
+   * any single call. Lookups check both arrays meanwhile.
+   */
+  uint8_t incremental_resize;
+  uint8_t backend; /* enum swiss_table_backend_id */
+} swiss_table_options_t;
+
 swiss_table_t* swiss_table_init(void);
 
+/* opts may be NULL. */
+swiss_table_t* swiss_table_init_opts(const swiss_table_options_t* opts);
+
+/* Shorthand for swiss_table_init_opts with only backend set; NULL for an unknown backend. */
+swiss_table_t* swiss_table_init_ex(uint8_t backend);
+
+/* Backend the table was created with, never SWISS_TABLE_BACKEND_AUTO. */
+uint8_t swiss_table_get_backend(const swiss_table_t* tbl_ptr);
+
+/* "auto", "cons", "simd" or "parallel"; NULL for an unknown backend. */
+const char* swiss_table_backend_name(uint8_t backend);
+
+/* Shorthand for swiss_table_init_opts with only capacity and max_load set. */
+swiss_table_t* swiss_table_init_with(size_t capacity, float max_load);
+
+/*
+ * Creates a table holding n key/value pairs, sized up front so nothing is
+ * rehashed. With the parallel backend the pairs are hashed and placed
+ * on all OpenMP threads. For duplicate keys the last pair wins. key_lens and
+ * data_lens may be NULL for NUL-terminated strings; opts may be NULL.
+ * Keys are hashed with the built-in hash. NULL on invalid input or
+ * allocation failure.
+ */
+swiss_table_t* swiss_table_build_from(const swiss_table_options_t* opts, const char* const* keys, const size_t* key_lens, const char* const* datas, const size_t* data_lens, size_t n);
+
 void swiss_table_set_hash(swiss_table_t* tbl_ptr, uint64_t (*hash)(const char*));
 
+/* Length-aware hash for every operation; takes precedence over swiss_table_set_hash. */
+void swiss_table_set_hash_n(swiss_table_t* tbl_ptr, uint64_t (*hash)(const char*, size_t));
+
+/*
+ * NO_ERR for a new key, UPDATED for an existing one. OUT_OF_MEMORY if the
+ * key or value cannot be copied, leaving the entry as it was, or if a new
+ * key needs the table to grow and it cannot.
+ */
 uint8_t swiss_table_insert_update(swiss_table_t* tbl_ptr, const char* key, const char* data);
 
 uint8_t swiss_table_delete(swiss_table_t* tbl_ptr, const char* key);
 
 char* swiss_table_get_copy(const swiss_table_t* tbl_ptr, const char* key);
 
+/*
+ * Length-aware variants. Keys and values may contain NUL bytes and are
+ * limited to UINT32_MAX bytes. Stored copies are always NUL-terminated.
+ * With only set_hash installed the key is copied to be terminated for
+ * hashing; if that copy cannot be allocated these return OUT_OF_MEMORY
+ * (NULL for pointer results).
+ */
+uint8_t swiss_table_insert_update_n(swiss_table_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len);
+
+uint8_t swiss_table_delete_n(swiss_table_t* tbl_ptr, const char* key, size_t key_len);
+
+/* data_len may be NULL. */
+char* swiss_table_get_copy_n(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, size_t* data_len);
+
+/*
+ * Borrowed view of the stored value, valid until the next insert, update,
+ * delete or destroy on the table. data_len may be NULL.
+ */
+const char* swiss_table_get_ref(const swiss_table_t* tbl_ptr, const char* key, size_t* data_len);
+
+const char* swiss_table_get_ref_n(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, size_t* data_len);
+
+/*
+ * Copies the value and a terminating NUL into buf. If cap is too small
+ * nothing is copied and BUFFER_TOO_SMALL is returned; data_len (may be
+ * NULL) receives the value length in either case.
+ */
+uint8_t swiss_table_get_into(const swiss_table_t* tbl_ptr, const char* key, char* buf, size_t cap, size_t* data_len);
+
+uint8_t swiss_table_get_into_n(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, char* buf, size_t cap, size_t* data_len);
+
+/*
+ * Batched lookups and inserts. Keys are hashed and their first groups
+ * prefetched a chunk at a time before any of them is probed, so the
+ * cache misses of different keys overlap. key_lens, data_lens (and for
+ * inserts, results) may be NULL, in which case keys and values are
+ * NUL-terminated strings. values[i] is a borrowed pointer as returned by
+ * swiss_table_get_ref, or NULL. get_batch returns the number of keys
+ * found; insert_batch stores each key's result code in results and
+ * returns the first failing code (INVALID_ARGS, OUT_OF_MEMORY), NO_ERR
+ * if every entry was stored.
+ */
+size_t swiss_table_get_batch(const swiss_table_t* tbl_ptr, const char* const* keys, const size_t* key_lens, size_t n, const char** values, size_t* data_lens);
+
+uint8_t swiss_table_insert_batch(swiss_table_t* tbl_ptr, const char* const* keys, const size_t* key_lens, const char* const* datas, const size_t* data_lens, size_t n, uint8_t* results);
+
+/*
+ * Cursor over the live entries, in no particular order. Keys and values
+ * are borrowed and, like the cursor itself, invalidated by any insert,
+ * update, delete or resize. Pointer arguments of next may be NULL.
+ */
+typedef struct swiss_table_iter
+{
+  const swiss_table_t* _tbl;
+  uint32_t _index;
+  uint8_t _phase;
+} swiss_table_iter_t;
+
+void swiss_table_iter_init(swiss_table_iter_t* iter, const swiss_table_t* tbl_ptr);
+
+/* Returns 0 once every entry has been returned. */
+uint8_t swiss_table_iter_next(swiss_table_iter_t* iter, const char** key, size_t* key_len, const char** data, size_t* data_len);
+
+/* visit must not modify the table. */
+typedef void (*swiss_table_visit_f)(const char* key, size_t key_len, const char* data, size_t data_len, void* ctx);
+
+void swiss_table_foreach(const swiss_table_t* tbl_ptr, swiss_table_visit_f visit, void* ctx);
+
+/*
+ * Resumable scan: start with cursor 0 and pass each returned cursor to the
+ * next call until it returns 0. Each call visits the entries of count home
+ * groups. The table may be modified and resized between calls: entries
+ * present for the whole scan are visited at least once, some possibly
+ * twice.
+ */
+uint64_t swiss_table_scan(const swiss_table_t* tbl_ptr, uint64_t cursor, uint32_t count, swiss_table_visit_f visit, void* ctx);
+
+/*
+ * Rehashes in place to clear the tombstones left by deletes, without
+ * changing capacity. Inserts do this on their own once tombstones push
+ * the table over its fill limit.
+ */
+uint8_t swiss_table_compact(swiss_table_t* tbl_ptr);
+
+/*
+ * Grows the table once so that entries fit without further rehashing.
+ * Never shrinks; returns OUT_OF_MEMORY if the new arrays cannot be
+ * allocated, leaving the table unchanged.
+ */
+uint8_t swiss_table_reserve(swiss_table_t* tbl_ptr, size_t entries);
+
+/* Rehashes into the smallest capacity that holds the current entries. */
+uint8_t swiss_table_shrink_to_fit(swiss_table_t* tbl_ptr);
+
+/* Probes of more groups than this share the last histogram bucket. */
+#define SWISS_TABLE_PROBE_BUCKETS 16
+
+typedef struct swiss_table_stats
+{
+  size_t size;
+  size_t capacity;
+  size_t tombstones;
+  double load_factor; /* size / capacity */
+  double tombstone_ratio; /* tombstones / capacity */
+  uint64_t resizes; /* rehashes into new arrays (growing, reserve, shrink_to_fit) */
+  uint64_t compactions; /* in-place rehashes that cleared tombstones */
+  /*
+   * Time spent in both. Entries moved by incremental_resize after the
+   * new arrays are allocated are only timed with SWISS_TABLE_STATS.
+   */
+  uint64_t rehash_ns;
+  size_t control_bytes;
+  size_t slot_bytes;
+  /* Out-of-line keys and values; with arena storage, the chunks held. */
+  size_t string_bytes;
+  /*
+   * Per-lookup counters, maintained only when the library is compiled
+   * with -DSWISS_TABLE_STATS (counters_enabled is then 1) and zero
+   * otherwise. probe_groups[i] counts lookups, inserts and deletes that
+   * examined i + 1 groups. A tag hit is a control byte equal to the
+   * key's 7-bit tag; a false positive is a hit on a slot holding another
+   * key. Concurrent readers of one table may lose increments.
+   */
+  uint8_t counters_enabled;
+  uint64_t probe_groups[SWISS_TABLE_PROBE_BUCKETS];
+  uint64_t tag_hits;
+  uint64_t tag_false_positives;
+} swiss_table_stats_t;
+
+/* Walks the table to sum string_bytes, so it costs O(capacity). */
+uint8_t swiss_table_get_stats(const swiss_table_t* tbl_ptr, swiss_table_stats_t* stats);
+
 void swiss_table_destroy(swiss_table_t* tbl_ptr);
+
+/*
+ * Writes a snapshot that swiss_table_open_mmap can serve without loading:
+ * control bytes, a slot array of offsets and a packed string heap, in
+ * native byte order. The file is written beside path and renamed over
+ * it. Returns IO_ERROR if the file cannot be written.
+ */
+uint8_t swiss_table_save(swiss_table_t* tbl_ptr, const char* path);
+
+/*
+ * Maps a snapshot read-only (MAP_SHARED, so processes share its pages)
+ * and answers lookups straight from the mapping. NULL if the file cannot
+ * be mapped or its layout is invalid; POSIX only. Snapshots of tables
+ * that used set_hash/set_hash_n need the same function set again.
+ */
+swiss_table_mapped_t* swiss_table_open_mmap(const char* path);
+
+void swiss_table_mapped_set_hash(swiss_table_mapped_t* mapped, uint64_t (*hash)(const char*));
+
+void swiss_table_mapped_set_hash_n(swiss_table_mapped_t* mapped, uint64_t (*hash)(const char*, size_t));
+
+/* Borrowed from the mapping, valid until swiss_table_mapped_close. */
+const char* swiss_table_mapped_get_ref(const swiss_table_mapped_t* mapped, const char* key, size_t* data_len);
+
+const char* swiss_table_mapped_get_ref_n(const swiss_table_mapped_t* mapped, const char* key, size_t key_len, size_t* data_len);
+
+size_t swiss_table_mapped_size(const swiss_table_mapped_t* mapped);
+
+void swiss_table_mapped_close(swiss_table_mapped_t* mapped);
+
+/* Stream callbacks return the number of bytes transferred; 0 means failure or end of input. */
+typedef size_t (*swiss_table_write_f)(void* ctx, const void* buf, size_t len);
+
+typedef size_t (*swiss_table_read_f)(void* ctx, void* buf, size_t len);
+
+/*
+ * Serialises the entries through write in checksummed blocks of about
+ * 64 KiB, with no full copy of the table. IO_ERROR if write comes up short.
+ */
+uint8_t swiss_table_write_stream(swiss_table_t* tbl_ptr, swiss_table_write_f write, void* ctx);
+
+/*
+ * Loads a stream into tbl_ptr, reserving room for the announced entry
+ * count first. Each block is verified (CRC32C) before any of its entries
+ * is inserted, so besides the table only one block is held in memory.
+ * Returns CORRUPT_DATA for a damaged stream and IO_ERROR if read fails
+ * before the end marker; entries of blocks verified before the error
+ * stay in the table.
+ */
+uint8_t swiss_table_read_stream(swiss_table_t* tbl_ptr, swiss_table_read_f read, void* ctx);
+
+/*
+ * Set of keys with no values, for membership tests. Same probing and
+ * options as the table (incremental_resize is ignored), with 16-byte
+ * slots and a single allocation per key. insert returns UPDATED if the
+ * key was already present and, like the table, OUT_OF_MEMORY for a new
+ * key once the set is full and cannot grow; contains returns 1 or 0.
+ */
+swiss_set_t* swiss_set_init(void);
+
+/* opts may be NULL. */
+swiss_set_t* swiss_set_init_opts(const swiss_table_options_t* opts);
+
+uint8_t swiss_set_insert(swiss_set_t* set_ptr, const char* key);
+
+uint8_t swiss_set_insert_n(swiss_set_t* set_ptr, const char* key, size_t key_len);
+
+uint8_t swiss_set_contains(const swiss_set_t* set_ptr, const char* key);
+
+uint8_t swiss_set_contains_n(const swiss_set_t* set_ptr, const char* key, size_t key_len);
+
+uint8_t swiss_set_erase(swiss_set_t* set_ptr, const char* key);
+
+uint8_t swiss_set_erase_n(swiss_set_t* set_ptr, const char* key, size_t key_len);
+
+size_t swiss_set_size(const swiss_set_t* set_ptr);
+
+void swiss_set_destroy(swiss_set_t* set_ptr);
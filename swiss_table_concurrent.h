@@ -0,0 +1,59 @@
+#pragma once
+
+#include "swiss_table.h"
+
+/*
+ * Thread-safe table built from independent swiss tables (shards). A key's
+ * shard is chosen by the high bits of its hash; each shard has its own
+ * writer lock and grows on its own, so writers only block writers that
+ * hit the same shard. Lookups take no lock: they validate against the
+ * shard's version counter and retry if a writer interfered, and memory
+ * they may still read is freed only after they finish (epoch-based
+ * reclamation). Shards use the backend selected by opts->backend; the
+ * library must be linked with -pthread.
+ *
+ * Semantics and return codes match swiss_table.h. There is no get_ref:
+ * a borrowed pointer could be freed by another thread as soon as the
+ * lookup returns. set_hash/set_hash_n must be called before the
+ * table is shared. A custom allocator must be thread-safe.
+ */
+typedef struct swiss_table_concurrent swiss_table_concurrent_t;
+
+swiss_table_concurrent_t* swiss_table_concurrent_init(void);
+
+/*
+ * opts may be NULL; its capacity is split evenly across shards and
+ * incremental_resize is ignored.
+ * shard_count is rounded up to a power of two, 0 selects the default.
+ */
+swiss_table_concurrent_t* swiss_table_concurrent_init_opts(const swiss_table_options_t* opts, uint32_t shard_count);
+
+void swiss_table_concurrent_set_hash(swiss_table_concurrent_t* tbl_ptr, uint64_t (*hash)(const char*));
+
+void swiss_table_concurrent_set_hash_n(swiss_table_concurrent_t* tbl_ptr, uint64_t (*hash)(const char*, size_t));
+
+uint8_t swiss_table_concurrent_insert_update(swiss_table_concurrent_t* tbl_ptr, const char* key, const char* data);
+
+uint8_t swiss_table_concurrent_insert_update_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len);
+
+uint8_t swiss_table_concurrent_delete(swiss_table_concurrent_t* tbl_ptr, const char* key);
+
+uint8_t swiss_table_concurrent_delete_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len);
+
+char* swiss_table_concurrent_get_copy(swiss_table_concurrent_t* tbl_ptr, const char* key);
+
+char* swiss_table_concurrent_get_copy_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, size_t* data_len);
+
+uint8_t swiss_table_concurrent_get_into(swiss_table_concurrent_t* tbl_ptr, const char* key, char* buf, size_t cap, size_t* data_len);
+
+uint8_t swiss_table_concurrent_get_into_n(swiss_table_concurrent_t* tbl_ptr, const char* key, size_t key_len, char* buf, size_t cap, size_t* data_len);
+
+/* Applied shard by shard; entries is split evenly across shards. */
+uint8_t swiss_table_concurrent_reserve(swiss_table_concurrent_t* tbl_ptr, size_t entries);
+
+uint8_t swiss_table_concurrent_shrink_to_fit(swiss_table_concurrent_t* tbl_ptr);
+
+uint8_t swiss_table_concurrent_compact(swiss_table_concurrent_t* tbl_ptr);
+
+/* Must not race with any other call on the table. */
+void swiss_table_concurrent_destroy(swiss_table_concurrent_t* tbl_ptr);
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "swiss_table.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Header-only typed tables. SWISS_TABLE_DEFINE(name, K, V, hash_fn, eq_fn)
+ * instantiates name_t and name_* functions for keys of type K and values
+ * of type V, both stored inline in the slot array: there is no allocation
+ * per entry and no pointer to follow on a tag match. hash_fn(K) returns a
+ * uint64_t and eq_fn(K, K) is nonzero for equal keys; both are called
+ * directly so they inline. Control bytes and probing are those of the
+ * string tables. SWISS_TABLE_DEFINE_U32/U64 instantiate integer-keyed
+ * tables with a built-in mixer; a u64 -> u64 map has 16-byte slots.
+ *
+ * Return codes are the ones in swiss_table.h. name_get returns a pointer
+ * to the value in the slot, valid until the next insert or delete.
+ */
+
+#define SWISS_GENERIC_GROUP_SIZE 16
+#define SWISS_GENERIC_MAX_FILL 0.7f
+#define SWISS_GENERIC_MAX_GROUP_COUNT (UINT32_MAX / 2 / SWISS_GENERIC_GROUP_SIZE + 1)
+#define SWISS_GENERIC_EMPTY 0x80
+#define SWISS_GENERIC_DELETED 0xfe
+#define SWISS_GENERIC_METADATA_MASK 0x7f
+#define SWISS_GENERIC_METADATA_BITS 7
+
+/* One bit per slot of the 16 control bytes at control equal to meta. */
+static inline uint32_t
+swiss_generic_match(const uint8_t* control, uint8_t meta)
+{
+#if defined(__SSE2__)
+  return (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)control), _mm_set1_epi8((char)meta)));
+#else
+  uint32_t mask = 0;
+  for (uint32_t index = 0; index < SWISS_GENERIC_GROUP_SIZE; ++index) {
+    mask |= (uint32_t)(control[index] == meta) << index;
+  }
+  return mask;
+#endif
+}
+
+/* EMPTY and DELETED have the high bit set, full slots do not. */
+static inline uint32_t
+swiss_generic_match_empty_or_deleted(const uint8_t* control)
+{
+#if defined(__SSE2__)
+  return (uint16_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)control));
+#else
+  uint32_t mask = 0;
+  for (uint32_t index = 0; index < SWISS_GENERIC_GROUP_SIZE; ++index) {
+    mask |= (uint32_t)(control[index] >> 7) << index;
+  }
+  return mask;
+#endif
+}
+
+/* Smallest group count that holds entries under the fill limit, or 0. */
+static inline uint32_t
+swiss_generic_group_count_for(size_t entries)
+{
+  for (uint32_t group_count = 1; group_count <= SWISS_GENERIC_MAX_GROUP_COUNT; group_count *= 2) {
+    if (entries <= (size_t)(group_count * SWISS_GENERIC_GROUP_SIZE * SWISS_GENERIC_MAX_FILL)) {
+      return group_count;
+    }
+  }
+  return 0;
+}
+
+/* Writes a control byte and its cloned copy past the end, if any. */
+static inline void
+swiss_generic_set_control(uint8_t* control, uint32_t capacity, uint32_t index, uint8_t meta)
+{
+  control[index] = meta;
+  if (index < SWISS_GENERIC_GROUP_SIZE) {
+    control[capacity + index] = meta;
+  }
+}
+
+/* First EMPTY or DELETED slot on h's probe sequence. */
+static inline uint32_t
+swiss_generic_find_free(const uint8_t* control, uint32_t slot_mask, uint64_t h)
+{
+  for (uint32_t pos = (h >> SWISS_GENERIC_METADATA_BITS) & slot_mask, step = SWISS_GENERIC_GROUP_SIZE;;pos = (pos + step) & slot_mask, step += SWISS_GENERIC_GROUP_SIZE) {
+    uint32_t free = swiss_generic_match_empty_or_deleted(control + pos);
+    if (free) {
+      return (pos + __builtin_ctz(free)) & slot_mask;
+    }
+  }
+}
+
+/*
+ * A deleted slot may become EMPTY again if no probe can have passed over
+ * it, i.e. the run of non-empty slots around it is shorter than a group.
+ */
+static inline uint8_t
+swiss_generic_was_never_full(const uint8_t* control, uint32_t slot_mask, uint32_t index)
+{
+  uint32_t empty_after = swiss_generic_match(control + index, SWISS_GENERIC_EMPTY);
+  uint32_t empty_before = swiss_generic_match(control + ((index - SWISS_GENERIC_GROUP_SIZE) & slot_mask), SWISS_GENERIC_EMPTY);
+  return empty_after && empty_before && (uint32_t)__builtin_ctz(empty_after) + (uint32_t)(__builtin_clz(empty_before) - 16) < SWISS_GENERIC_GROUP_SIZE;
+}
+
+/* Integer fast paths: the MurmurHash3 finalizer spreads every input bit into the tag and H1. */
+static inline uint64_t
+swiss_table_hash_u64(uint64_t key)
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33;
+  return key;
+}
+
+static inline uint64_t
+swiss_table_hash_u32(uint32_t key)
+{
+  return swiss_table_hash_u64(key);
+}
+
+static inline int
+swiss_table_eq_u64(uint64_t lhs, uint64_t rhs)
+{
+  return lhs == rhs;
+}
+
+static inline int
+swiss_table_eq_u32(uint32_t lhs, uint32_t rhs)
+{
+  return lhs == rhs;
+}
+
+#define SWISS_TABLE_DEFINE_U32(name, V) SWISS_TABLE_DEFINE(name, uint32_t, V, swiss_table_hash_u32, swiss_table_eq_u32)
+
+#define SWISS_TABLE_DEFINE_U64(name, V) SWISS_TABLE_DEFINE(name, uint64_t, V, swiss_table_hash_u64, swiss_table_eq_u64)
+
+#define SWISS_TABLE_DEFINE(name, K, V, hash_fn, eq_fn) \
+typedef struct name##_slot \
+{ \
+  K key; \
+  V value; \
+} name##_slot_t; \
+\
+typedef struct name \
+{ \
+  uint8_t* _control; \
+  name##_slot_t* _slots; \
+  uint32_t _group_count; \
+  uint32_t _current_size; \
+  uint32_t _deleted; \
+} name##_t; \
+\
+static inline uint32_t \
+name##_capacity(const name##_t* tbl_ptr) \
+{ \
+  return tbl_ptr->_group_count * SWISS_GENERIC_GROUP_SIZE; \
+} \
+\
+/* Moves every entry into fresh arrays of group_count groups; 0 if allocation fails. */ \
+static inline uint8_t \
+name##_resize(name##_t* tbl_ptr, uint32_t group_count) \
+{ \
+  uint32_t capacity = group_count * SWISS_GENERIC_GROUP_SIZE; \
+  uint8_t* control = (uint8_t*)malloc(capacity + SWISS_GENERIC_GROUP_SIZE); \
+  name##_slot_t* slots = (name##_slot_t*)malloc(capacity * sizeof(name##_slot_t)); \
+  if (!control || !slots) { \
+    free(control); \
+    free(slots); \
+    return 0; \
+  } \
+  memset(control, SWISS_GENERIC_EMPTY, capacity + SWISS_GENERIC_GROUP_SIZE); \
+  for (uint32_t old_index = 0; old_index < name##_capacity(tbl_ptr); ++old_index) { \
+    if ((int8_t)tbl_ptr->_control[old_index] >= 0) { \
+      uint64_t h = hash_fn(tbl_ptr->_slots[old_index].key); \
+      uint32_t index = swiss_generic_find_free(control, capacity - 1, h); \
+      swiss_generic_set_control(control, capacity, index, h & SWISS_GENERIC_METADATA_MASK); \
+      slots[index] = tbl_ptr->_slots[old_index]; \
+    } \
+  } \
+  free(tbl_ptr->_control); \
+  free(tbl_ptr->_slots); \
+  tbl_ptr->_control = control; \
+  tbl_ptr->_slots = slots; \
+  tbl_ptr->_group_count = group_count; \
+  tbl_ptr->_deleted = 0; \
+  return 1; \
+} \
+\
+/* capacity is the number of entries to hold without rehashing. */ \
+static inline name##_t* \
+name##_init_with(size_t capacity) \
+{ \
+  uint32_t group_count = swiss_generic_group_count_for(capacity); \
+  if (!group_count) { \
+    return NULL; \
+  } \
+  name##_t* new_table = (name##_t*)calloc(1, sizeof(name##_t)); \
+  if (!new_table) { \
+    return NULL; \
+  } \
+  if (!name##_resize(new_table, group_count)) { \
+    free(new_table); \
+    return NULL; \
+  } \
+  return new_table; \
+} \
+\
+static inline name##_t* \
+name##_init(void) \
+{ \
+  return name##_init_with(0); \
+} \
+\
+static inline name##_slot_t* \
+name##_find(const name##_t* tbl_ptr, K key, uint64_t h) \
+{ \
+  uint32_t slot_mask = name##_capacity(tbl_ptr) - 1; \
+  uint8_t metadata = h & SWISS_GENERIC_METADATA_MASK; \
+  for (uint32_t pos = (h >> SWISS_GENERIC_METADATA_BITS) & slot_mask, step = SWISS_GENERIC_GROUP_SIZE;;pos = (pos + step) & slot_mask, step += SWISS_GENERIC_GROUP_SIZE) { \
+    for (uint32_t match = swiss_generic_match(tbl_ptr->_control + pos, metadata); match; match &= match - 1) { \
+      name##_slot_t* slot = &tbl_ptr->_slots[(pos + __builtin_ctz(match)) & slot_mask]; \
+      if (eq_fn(slot->key, key)) { \
+        return slot; \
+      } \
+    } \
+    if (swiss_generic_match(tbl_ptr->_control + pos, SWISS_GENERIC_EMPTY)) { \
+      return NULL; \
+    } \
+  } \
+} \
+\
+static inline V* \
+name##_get(const name##_t* tbl_ptr, K key) \
+{ \
+  if (!tbl_ptr) { \
+    return NULL; \
+  } \
+  name##_slot_t* slot = name##_find(tbl_ptr, key, hash_fn(key)); \
+  return slot ? &slot->value : NULL; \
+} \
+\
+static inline uint8_t \
+name##_insert_update(name##_t* tbl_ptr, K key, V value) \
+{ \
+  if (!tbl_ptr) { \
+    return INVALID_ARGS; \
+  } \
+  uint64_t h = hash_fn(key); \
+  name##_slot_t* slot = name##_find(tbl_ptr, key, h); \
+  if (slot) { \
+    slot->value = value; \
+    return UPDATED; \
+  } \
+  uint32_t limit = name##_capacity(tbl_ptr) * SWISS_GENERIC_MAX_FILL; \
+  if (tbl_ptr->_current_size + tbl_ptr->_deleted >= limit) { \
+    /* Rehash in place when dropping tombstones frees enough room. */ \
+    uint32_t group_count = tbl_ptr->_current_size < limit / 2 ? tbl_ptr->_group_count : tbl_ptr->_group_count * 2; \
+    if (group_count > SWISS_GENERIC_MAX_GROUP_COUNT || !name##_resize(tbl_ptr, group_count)) { \
+      return OUT_OF_MEMORY; \
+    } \
+  } \
+  uint32_t index = swiss_generic_find_free(tbl_ptr->_control, name##_capacity(tbl_ptr) - 1, h); \
+  tbl_ptr->_deleted -= tbl_ptr->_control[index] == SWISS_GENERIC_DELETED; \
+  swiss_generic_set_control(tbl_ptr->_control, name##_capacity(tbl_ptr), index, h & SWISS_GENERIC_METADATA_MASK); \
+  tbl_ptr->_slots[index].key = key; \
+  tbl_ptr->_slots[index].value = value; \
+  ++tbl_ptr->_current_size; \
+  return NO_ERR; \
+} \
+\
+static inline uint8_t \
+name##_delete(name##_t* tbl_ptr, K key) \
+{ \
+  if (!tbl_ptr) { \
+    return INVALID_ARGS; \
+  } \
+  name##_slot_t* slot = name##_find(tbl_ptr, key, hash_fn(key)); \
+  if (!slot) { \
+    return KEY_NOT_FOUND; \
+  } \
+  uint32_t index = slot - tbl_ptr->_slots; \
+  uint8_t never_full = swiss_generic_was_never_full(tbl_ptr->_control, name##_capacity(tbl_ptr) - 1, index); \
+  swiss_generic_set_control(tbl_ptr->_control, name##_capacity(tbl_ptr), index, never_full ? SWISS_GENERIC_EMPTY : SWISS_GENERIC_DELETED); \
+  tbl_ptr->_deleted += !never_full; \
+  --tbl_ptr->_current_size; \
+  return NO_ERR; \
+} \
+\
+/* Grows so that entries fit without rehashing; never shrinks. */ \
+static inline uint8_t \
+name##_reserve(name##_t* tbl_ptr, size_t entries) \
+{ \
+  if (!tbl_ptr) { \
+    return INVALID_ARGS; \
+  } \
+  uint32_t group_count = swiss_generic_group_count_for(entries); \
+  if (!group_count) { \
+    return OUT_OF_MEMORY; \
+  } \
+  if (group_count <= tbl_ptr->_group_count) { \
+    return NO_ERR; \
+  } \
+  return name##_resize(tbl_ptr, group_count) ? NO_ERR : OUT_OF_MEMORY; \
+} \
+\
+static inline size_t \
+name##_size(const name##_t* tbl_ptr) \
+{ \
+  return tbl_ptr ? tbl_ptr->_current_size : 0; \
+} \
+\
+/* \
+ * Next full slot at or after *cursor (start at 0), or NULL at the end. \
+ * Advances *cursor past it; inserts and deletes invalidate the cursor. \
+ */ \
+static inline name##_slot_t* \
+name##_next(const name##_t* tbl_ptr, uint32_t* cursor) \
+{ \
+  if (!tbl_ptr) { \
+    return NULL; \
+  } \
+  for (; *cursor < name##_capacity(tbl_ptr); ++*cursor) { \
+    if ((int8_t)tbl_ptr->_control[*cursor] >= 0) { \
+      return &tbl_ptr->_slots[(*cursor)++]; \
+    } \
+  } \
+  return NULL; \
+} \
+\
+static inline void \
+name##_destroy(name##_t* tbl_ptr) \
+{ \
+  if (!tbl_ptr) { \
+    return; \
+  } \
+  free(tbl_ptr->_control); \
+  free(tbl_ptr->_slots); \
+  free(tbl_ptr); \
+}
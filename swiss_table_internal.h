@@ -0,0 +1,488 @@
+#pragma once
+
+/*
+ * Layout and helpers shared by the core (swiss_table.c) and the probe
+ * backends (cons/, simd/, parallel/). Not part of the public API.
+ */
+#include "swiss_table.h"
+
+#define GROUP_SIZE 16
+#define MAX_GROUP_COUNT (UINT32_MAX / 2 / GROUP_SIZE + 1)
+/* Below this many entries rehashing and bulk builds stay single-threaded. */
+#define PARALLEL_MIN_ENTRIES (1u << 16)
+
+/* Slot bytes for a key and its NUL; longer keys are stored out of line. */
+#define INLINE_KEY_SIZE 16
+
+#define DELETED 0xfe
+#define EMPTY 0x80
+
+/* Low 7 hash bits are the control tag (H2), the rest pick the start slot (H1). */
+#define METADATA_MASK 0x7f
+#define METADATA_BITS 7
+
+/*
+ * Keys and values are stored with their lengths and the key's full hash,
+ * so a tag match is confirmed without touching key memory in most cases.
+ * Keys shorter than INLINE_KEY_SIZE bytes live NUL-terminated in the slot
+ * itself; only longer ones get a separate allocation.
+ */
+struct swiss_table_node
+{
+  union
+  {
+    char* _ptr;
+    char _inline[INLINE_KEY_SIZE];
+    /* The same bytes, for copies made with atomic word accesses. */
+    uint64_t _words[INLINE_KEY_SIZE / sizeof(uint64_t)];
+  } _key;
+  char* _data;
+  uint32_t _key_len;
+  uint32_t _data_len;
+  uint64_t _hash;
+};
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_MIN_CLASS 16
+#define ARENA_CLASS_COUNT 8
+
+/*
+ * Size-class arena for key and value bytes. Blocks up to the largest
+ * class are bump-allocated from chunks and recycled through per-class
+ * free lists; larger ones get their own allocation on the _large list.
+ */
+typedef struct arena_block
+{
+  struct arena_block* _prev;
+  struct arena_block* _next;
+  size_t _size;
+} arena_block_t;
+
+typedef struct arena
+{
+  arena_block_t* _chunks;
+  arena_block_t* _large;
+  char* _cursor;
+  char* _end;
+  void* _free[ARENA_CLASS_COUNT];
+} arena_t;
+
+#define READER_SLOTS 128
+#define RECLAIM_BATCH 64
+#define CACHE_LINE_SIZE 64
+
+/* Epoch a lock-free reader entered at, 0 while the slot is free. */
+typedef struct reader_slot
+{
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t _epoch;
+} reader_slot_t;
+
+typedef struct epoch_domain
+{
+  _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t _epoch;
+  reader_slot_t _readers[READER_SLOTS];
+} epoch_domain_t;
+
+typedef struct retired
+{
+  void* _ptr;
+  size_t _size;
+  uint64_t _epoch;
+  uint8_t _bytes; /* key/value bytes rather than a table array */
+} retired_t;
+
+/*
+ * Tables behind a concurrent shard do not free keys, values or old
+ * arrays directly: lock-free readers may still be looking at them. They
+ * are retired here with the current epoch and released once no reader
+ * that entered at or before that epoch is still active.
+ */
+typedef struct reclaim
+{
+  retired_t* _items;
+  size_t _count;
+  size_t _cap;
+  epoch_domain_t* _domain;
+} reclaim_t;
+
+/*
+ * Lookup counters behind swiss_table_get_stats. Kernels report through
+ * STATS_PROBE and STATS_TAG, which compile to nothing unless
+ * SWISS_TABLE_STATS is defined. Counts are bumped with a relaxed load and
+ * store rather than an atomic add, so readers sharing a table can lose
+ * increments but never race.
+ */
+typedef struct stats_counters
+{
+  uint64_t _probe_groups[SWISS_TABLE_PROBE_BUCKETS];
+  uint64_t _tag_hits;
+  uint64_t _tag_false_positives;
+} stats_counters_t;
+
+/* Accepts or rejects the entry in a slot whose tag matched; see find_match. */
+typedef uint8_t (*slot_match_f)(const void* ctx, uint32_t index);
+
+/*
+ * Probe kernels of one backend, chosen per table when it is created.
+ * Each one works on the arrays of the table it is given only; following
+ * an incremental resize into _old is left to the core. Except for
+ * find_match, they rely on the table having an EMPTY slot.
+ */
+typedef struct swiss_table_backend
+{
+  const char* _name;
+  uint8_t _id;
+  /* Slot holding key, UINT32_MAX if absent. */
+  uint32_t (*find)(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h);
+  /* Slot holding key with *found set, else the first EMPTY or DELETED slot of its probe sequence. */
+  uint32_t (*find_slot)(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h, uint8_t* found);
+  /* Insert-only probe: first EMPTY or DELETED slot for h, no duplicate check. */
+  uint32_t (*find_free_slot)(const swiss_table_t* tbl_ptr, uint64_t h);
+  /*
+   * First slot with h's tag that match accepts, looking at no more than
+   * probe_limit groups; UINT32_MAX if none. For slot arrays other than
+   * _slots (sets, mapped snapshots). If free_slot is given and nothing
+   * matches, it receives the first EMPTY or DELETED slot of the probe,
+   * as find_slot returns.
+   */
+  uint32_t (*find_match)(const swiss_table_t* tbl_ptr, uint64_t h, uint32_t probe_limit, slot_match_f match, const void* ctx, uint32_t* free_slot);
+  /*
+   * A slot may be marked EMPTY again only if no probe could have walked
+   * over it, i.e. the run of non-empty slots around it is shorter than a
+   * group.
+   */
+  uint8_t (*was_never_full)(const swiss_table_t* tbl_ptr, uint32_t index);
+  /* First full slot at or after index, capacity if none. */
+  uint32_t (*next_full)(const uint8_t* control, uint32_t capacity, uint32_t index);
+  /*
+   * Places count nodes (those with a full byte in full, if given) into
+   * the table's freshly allocated arrays and returns how many entries
+   * were added; with dedup, a repeated key keeps the node whose _data is
+   * higher. NULL if the backend has no bulk placement, in which case the
+   * core places nodes one by one with find_free_slot.
+   */
+  size_t (*place_all)(swiss_table_t* tbl_ptr, const node_t* nodes, const uint8_t* full, size_t count, uint8_t dedup);
+} swiss_table_backend_t;
+
+extern const swiss_table_backend_t swiss_table_backend_cons;
+extern const swiss_table_backend_t swiss_table_backend_simd;
+extern const swiss_table_backend_t swiss_table_backend_parallel;
+
+/*
+ * _control holds one byte per slot followed by GROUP_SIZE cloned bytes
+ * mirroring the first group, so a group can be read starting at any slot
+ * without wrapping by hand. _slots is a single array of nodes.
+ */
+struct swiss_table
+{
+  uint8_t* _control;
+  node_t* _slots;
+  uint32_t _group_count;
+  uint32_t _current_size;
+  uint32_t _deleted;
+  float _max_load;
+  uint8_t _incremental;
+  /*
+   * Arrays being drained by an incremental resize (only _control, _slots,
+   * _group_count and _backend are used), NULL otherwise. Slots below
+   * _migrate_pos have been moved; moved slots are left DELETED so the
+   * remaining entries stay reachable.
+   */
+  swiss_table_t* _old;
+  uint32_t _migrate_pos;
+  uint64_t _seed;
+  uint64_t (*hash_f)(const char*);
+  uint64_t (*hash_n_f)(const char*, size_t);
+  swiss_table_allocator_t _allocator;
+  arena_t _arena;
+  uint8_t _storage;
+  const swiss_table_backend_t* _backend;
+  reclaim_t* _reclaim;
+  uint64_t _resizes;
+  uint64_t _compactions;
+  uint64_t _rehash_ns;
+  /* Updated by lookups, which only get a const table. */
+  stats_counters_t _counters;
+};
+
+/*
+ * Built-in hash: wyhash (final version 4 constants). Short keys are read
+ * with at most three overlapping loads, longer ones 16 or 48 bytes per
+ * step. Every table gets its own random seed so colliding key sets cannot
+ * be precomputed.
+ */
+static const uint64_t hash_secret[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+static inline void
+hash_mum(uint64_t* a, uint64_t* b)
+{
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+hash_mix(uint64_t a, uint64_t b)
+{
+  hash_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t
+hash_read8(const uint8_t* p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+hash_read4(const uint8_t* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+hash(const char* key, size_t len, uint64_t seed)
+{
+  const uint8_t* p = (const uint8_t*)key;
+  uint64_t a, b;
+  seed ^= hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (hash_read4(p) << 32) | hash_read4(p + ((len >> 3) << 2));
+      b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        seed = hash_mix(hash_read8(p) ^ hash_secret[1], hash_read8(p + 8) ^ seed);
+        seed1 = hash_mix(hash_read8(p + 16) ^ hash_secret[2], hash_read8(p + 24) ^ seed1);
+        seed2 = hash_mix(hash_read8(p + 32) ^ hash_secret[3], hash_read8(p + 40) ^ seed2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (i > 16) {
+      seed = hash_mix(hash_read8(p) ^ hash_secret[1], hash_read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = hash_read8(p + i - 16);
+    b = hash_read8(p + i - 8);
+  }
+  a ^= hash_secret[1];
+  b ^= seed;
+  hash_mum(&a, &b);
+  return hash_mix(a ^ hash_secret[0] ^ len, b ^ hash_secret[1]);
+}
+
+/* key must be NUL-terminated at key[key_len]. */
+static inline uint64_t
+key_hash(const swiss_table_t* tbl_ptr, const char* key, size_t key_len)
+{
+  if (tbl_ptr->hash_n_f) {
+    return tbl_ptr->hash_n_f(key, key_len);
+  }
+  if (tbl_ptr->hash_f) {
+    return tbl_ptr->hash_f(key);
+  }
+  return hash(key, key_len, tbl_ptr->_seed);
+}
+
+/*
+ * Hash of a key that is not NUL-terminated. A set_hash function gets a
+ * terminated copy; returns 0 if that copy cannot be allocated.
+ */
+static inline uint8_t
+key_hash_n(const swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t* h)
+{
+  if (tbl_ptr->hash_n_f || !tbl_ptr->hash_f) {
+    *h = key_hash(tbl_ptr, key, key_len);
+    return 1;
+  }
+  char buf[64];
+  char* tmp = key_len < sizeof(buf) ? buf : (char*)malloc(key_len + 1);
+  if (!tmp) {
+    return 0;
+  }
+  memcpy(tmp, key, key_len);
+  tmp[key_len] = '\0';
+  *h = tbl_ptr->hash_f(tmp);
+  if (tmp != buf) {
+    free(tmp);
+  }
+  return 1;
+}
+
+static inline char*
+dup_bytes(const char* src, size_t len)
+{
+  char* dst = (char*)malloc(len + 1);
+  if (dst) {
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+  }
+  return dst;
+}
+
+static inline const char*
+node_key(const node_t* node)
+{
+  return node->_key_len < INLINE_KEY_SIZE ? node->_key._inline : node->_key._ptr;
+}
+
+static inline uint8_t
+node_has_key(const node_t* node, const char* key, size_t key_len, uint64_t h)
+{
+  return node->_hash == h && node->_key_len == key_len && !memcmp(node_key(node), key, key_len);
+}
+
+#if defined(SWISS_TABLE_STATS)
+static inline void
+stats_bump(const uint64_t* counter)
+{
+  uint64_t* target = (uint64_t*)counter;
+  __atomic_store_n(target, __atomic_load_n(target, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+static inline void
+stats_probe(const swiss_table_t* tbl_ptr, uint32_t groups)
+{
+  if (!groups) {
+    return;
+  }
+  stats_bump(&tbl_ptr->_counters._probe_groups[(groups < SWISS_TABLE_PROBE_BUCKETS ? groups : SWISS_TABLE_PROBE_BUCKETS) - 1]);
+}
+
+static inline uint8_t
+stats_tag(const swiss_table_t* tbl_ptr, uint8_t hit)
+{
+  stats_bump(&tbl_ptr->_counters._tag_hits);
+  if (!hit) {
+    stats_bump(&tbl_ptr->_counters._tag_false_positives);
+  }
+  return hit;
+}
+
+/* A probe ended after examining groups groups. */
+#define STATS_PROBE(tbl_ptr, groups) stats_probe(tbl_ptr, groups)
+/* Records whether the slot behind a tag hit held the key; evaluates to hit. */
+#define STATS_TAG(tbl_ptr, hit) stats_tag(tbl_ptr, hit)
+#else
+#define STATS_PROBE(tbl_ptr, groups) ((void)0)
+#define STATS_TAG(tbl_ptr, hit) (hit)
+#endif
+
+static inline void*
+tbl_alloc(const swiss_table_t* tbl_ptr, size_t size, size_t align)
+{
+  return tbl_ptr->_allocator.alloc(tbl_ptr->_allocator.ctx, size, align);
+}
+
+static inline void
+tbl_free(const swiss_table_t* tbl_ptr, void* ptr, size_t size)
+{
+  if (ptr) {
+    tbl_ptr->_allocator.free(tbl_ptr->_allocator.ctx, ptr, size);
+  }
+}
+
+static inline uint32_t
+capacity(const swiss_table_t* tbl_ptr)
+{
+  return tbl_ptr->_group_count * GROUP_SIZE;
+}
+
+/* Capacity is always a power of two, so slot indices wrap with a mask. */
+static inline uint32_t
+slot_mask(const swiss_table_t* tbl_ptr)
+{
+  return capacity(tbl_ptr) - 1;
+}
+
+static inline uint32_t
+probe_start(const swiss_table_t* tbl_ptr, uint64_t h)
+{
+  return (h >> METADATA_BITS) & slot_mask(tbl_ptr);
+}
+
+/*
+ * Slots of a concurrent table's shard are read by lock-free readers while
+ * a writer changes them (parallel/swiss_table.c), so every write to a
+ * published control byte or node is an atomic store; the readers load
+ * the same bytes atomically and let the seqlock reject a torn copy.
+ */
+static inline void
+set_control(swiss_table_t* tbl_ptr, uint32_t index, uint8_t value)
+{
+  __atomic_store_n(&tbl_ptr->_control[index], value, __ATOMIC_RELEASE);
+  if (index < GROUP_SIZE) {
+    __atomic_store_n(&tbl_ptr->_control[capacity(tbl_ptr) + index], value, __ATOMIC_RELEASE);
+  }
+}
+
+static inline void
+store_node(node_t* dst, const node_t* src)
+{
+  for (uint32_t word = 0; word < INLINE_KEY_SIZE / sizeof(uint64_t); ++word) {
+    __atomic_store_n(&dst->_key._words[word], src->_key._words[word], __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&dst->_data, src->_data, __ATOMIC_RELAXED);
+  __atomic_store_n(&dst->_key_len, src->_key_len, __ATOMIC_RELAXED);
+  __atomic_store_n(&dst->_data_len, src->_data_len, __ATOMIC_RELAXED);
+  __atomic_store_n(&dst->_hash, src->_hash, __ATOMIC_RELAXED);
+}
+
+static inline size_t
+control_size(uint32_t capacity)
+{
+  return (size_t)capacity + GROUP_SIZE;
+}
+
+static inline uint8_t
+copy_into(const node_t* node, char* buf, size_t cap, size_t* data_len)
+{
+  if (!node) {
+    return KEY_NOT_FOUND;
+  }
+  if (data_len) {
+    *data_len = node->_data_len;
+  }
+  if (cap <= node->_data_len) {
+    return BUFFER_TOO_SMALL;
+  }
+  memcpy(buf, node->_data, node->_data_len + 1);
+  return NO_ERR;
+}
+
+void* swiss_table_default_alloc(void* ctx, size_t size, size_t align);
+
+void swiss_table_default_free(void* ctx, void* ptr, size_t size);
+
+/* insert_update and delete with the hash already computed; len arguments must fit in 32 bits. */
+uint8_t swiss_table_insert_hashed(swiss_table_t* tbl_ptr, const char* key, size_t key_len, const char* data, size_t data_len, uint64_t h);
+
+uint8_t swiss_table_erase_hashed(swiss_table_t* tbl_ptr, const char* key, size_t key_len, uint64_t h);
+
+/* Frees everything still retired to the table's reclaim list and detaches it. */
+void swiss_table_reclaim_release(swiss_table_t* tbl_ptr);
@@ -1,100 +1,84 @@
 #include "swiss_table.h"
+#include "swiss_table_generic.h"
 #include <stdio.h>
 #include <assert.h>
 #include <omp.h>
+#include <unistd.h>
 
-static double
+static void
 simple_insert_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
   const int iter_max = 100;
-  double start, end, total = 0;
   char tmp[10] = { 0 };
   for (int i = 0; i < iter_max; ++i) {
     sprintf(tmp, "%d", i);
-    start = omp_get_wtime();
     int err = swiss_table_insert_update(tbl, tmp, tmp);
-    end = omp_get_wtime();
     assert(err == NO_ERR);
-    total += (end - start);
   }
   swiss_table_destroy(tbl);
-  return total / iter_max;
 }
 
-static double
+static void
 huge_insert_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
   const int iter_max = 1000;
-  double start, end, total = 0;
   char tmp[10] = { 0 };
   for (int i = 0; i < iter_max; ++i) {
     sprintf(tmp, "%d", i);
-    start = omp_get_wtime();
     int err = swiss_table_insert_update(tbl, tmp, tmp);
-    end = omp_get_wtime();
     assert(err == NO_ERR);
-    total += (end - start);
   }
   swiss_table_destroy(tbl);
-  return total / iter_max;
 }
 
-static double
+static void
+million_insert_test(void)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  const int iter_max = 1000000;
+  char tmp[10] = { 0 };
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int err = swiss_table_insert_update(tbl, tmp, tmp);
+    assert(err == NO_ERR);
+  }
+  swiss_table_destroy(tbl);
+}
+
+static void
 strange_args_insert_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
-  double start, end, total = 0;
-  int err, test_count = 0;
-  start = omp_get_wtime();
+  int err;
   err = swiss_table_insert_update(NULL, "123", "1");
-  end = omp_get_wtime();
   assert(err == INVALID_ARGS);
-  total += (end - start);
-  ++test_count;
-  start = omp_get_wtime();
   err = swiss_table_insert_update(tbl, NULL, "22");
-  end = omp_get_wtime();
   assert(err == INVALID_ARGS);
-  total += (end - start);
-  ++test_count;
-  start = omp_get_wtime();
   err = swiss_table_insert_update(tbl, "123", NULL);
-  end = omp_get_wtime();
   assert(err == INVALID_ARGS);
-  total += (end - start);
-  ++test_count;
   swiss_table_insert_update(tbl, "123", "123");
-  start = omp_get_wtime();
   err = swiss_table_insert_update(tbl, "123", "456");
-  end = omp_get_wtime();
   assert(err == UPDATED);
-  total += (end - start);
-  ++test_count;
   char long_str[128 * 3 + 1] = { 0 };
   for (int i = 0; i < 128; ++i) {
     strcat(long_str, "123");
   }
-  start = omp_get_wtime();
   err = swiss_table_insert_update(tbl, long_str, "123");
-  end = omp_get_wtime();
   assert(err == NO_ERR);
-  total += (end - start);
-  ++test_count;
   swiss_table_destroy(tbl);
-  return total / test_count;
 }
 
-static double
+static void
 simple_search_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
-  double start, end, total = 0;
   const int iter_max = 100;
   char tmp[10] = { 0 };
   for (int i = 0; i < iter_max; ++i) {
@@ -104,24 +88,19 @@ simple_search_test(void)
   }
   for (int i = 0; i < iter_max; ++i) {
     sprintf(tmp, "%d", i);
-    start = omp_get_wtime();
     char* res = swiss_table_get_copy(tbl, tmp);
-    end = omp_get_wtime();
     assert(res);
     assert(!strcmp(tmp, res));
     free(res);
-    total += (end - start);
   }
   swiss_table_destroy(tbl);
-  return total / iter_max;
 }
 
-static double
+static void
 huge_search_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
-  double start, end, total = 0;
   const int iter_max = 1000;
   char tmp[10] = { 0 };
   for (int i = 0; i < iter_max; ++i) {
@@ -131,55 +110,162 @@ huge_search_test(void)
   }
   for (int i = 0; i < iter_max; ++i) {
     sprintf(tmp, "%d", i);
-    start = omp_get_wtime();
     char* res = swiss_table_get_copy(tbl, tmp);
-    end = omp_get_wtime();
     assert(res);
     assert(!strcmp(tmp, res));
     free(res);
-    total += (end - start);
   }
   swiss_table_destroy(tbl);
-  return total / iter_max;
 }
 
-static double
+#define MILLION 1000000
+
+/* Table mapping the keys "0" .. "count - 1" to themselves. */
+static swiss_table_t*
+numbered_table(int count)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  char tmp[12] = { 0 };
+  for (int i = 0; i < count; ++i) {
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    int err = swiss_table_insert_update(tbl, tmp, tmp);
+    assert(err == NO_ERR);
+  }
+  return tbl;
+}
+
+/* The million search tests share one numbered_table(MILLION). */
+static void
+million_search_test(const swiss_table_t* tbl)
+{
+  char tmp[12] = { 0 };
+  for (int i = 0; i < MILLION; ++i) {
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    char* res = swiss_table_get_copy(tbl, tmp);
+    assert(res);
+    assert(!strcmp(tmp, res));
+    free(res);
+  }
+}
+
+static void
+million_search_ref_test(const swiss_table_t* tbl)
+{
+  char tmp[12] = { 0 };
+  for (int i = 0; i < MILLION; ++i) {
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    size_t data_len = 0;
+    const char* res = swiss_table_get_ref(tbl, tmp, &data_len);
+    assert(res);
+    assert(data_len == strlen(tmp) && !strcmp(tmp, res));
+  }
+}
+
+static void
+million_search_into_test(const swiss_table_t* tbl)
+{
+  char tmp[12] = { 0 };
+  char buf[12] = { 0 };
+  for (int i = 0; i < MILLION; ++i) {
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    int err = swiss_table_get_into(tbl, tmp, buf, sizeof(buf), NULL);
+    assert(err == NO_ERR);
+    assert(!strcmp(tmp, buf));
+  }
+  size_t data_len = 0;
+  assert(swiss_table_get_into(tbl, "12345", buf, 5, &data_len) == BUFFER_TOO_SMALL);
+  assert(data_len == 5);
+  assert(swiss_table_get_into(tbl, "-1", buf, sizeof(buf), NULL) == KEY_NOT_FOUND);
+  assert(!swiss_table_get_ref(tbl, "-1", NULL));
+}
+
+/* Batch lookups must agree with single lookups, down to the value pointer. */
+static void
+million_search_batch_test(const swiss_table_t* tbl)
+{
+  const int batch_size = 16;
+  char keys_buf[16][12];
+  const char* keys[16];
+  const char* values[16];
+  size_t data_lens[16];
+  for (int i = 0; i < MILLION; i += batch_size) {
+    for (int j = 0; j < batch_size; ++j) {
+      snprintf(keys_buf[j], sizeof(keys_buf[j]), "%d", i + j);
+      keys[j] = keys_buf[j];
+    }
+    size_t found = swiss_table_get_batch(tbl, keys, NULL, batch_size, values, data_lens);
+    assert(found == (size_t)batch_size);
+    for (int j = 0; j < batch_size; ++j) {
+      size_t data_len = 0;
+      const char* res = swiss_table_get_ref(tbl, keys[j], &data_len);
+      assert(values[j] && values[j] == res && data_lens[j] == data_len);
+      assert(data_len == strlen(keys[j]) && !strcmp(values[j], keys[j]));
+    }
+  }
+  keys[0] = "missing";
+  keys[1] = NULL;
+  assert(swiss_table_get_batch(tbl, keys, NULL, 2, values, NULL) == 0);
+  assert(!values[0] && !values[1]);
+  assert(swiss_table_get_batch(NULL, keys, NULL, 1, values, NULL) == 0);
+}
+
+static void
+insert_batch_test(void)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  const int iter_max = 100000;
+  const int batch_size = 16;
+  char keys_buf[16][12];
+  const char* keys[16];
+  uint8_t results[16];
+  for (int i = 0; i < iter_max; i += batch_size) {
+    for (int j = 0; j < batch_size; ++j) {
+      snprintf(keys_buf[j], sizeof(keys_buf[j]), "%d", i + j);
+      keys[j] = keys_buf[j];
+    }
+    assert(swiss_table_insert_batch(tbl, keys, NULL, keys, NULL, batch_size, results) == NO_ERR);
+    for (int j = 0; j < batch_size; ++j) {
+      assert(results[j] == NO_ERR);
+    }
+  }
+  char tmp[12] = { 0 };
+  for (int i = 0; i < iter_max; ++i) {
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    size_t data_len = 0;
+    const char* res = swiss_table_get_ref(tbl, tmp, &data_len);
+    assert(res && data_len == strlen(tmp) && !strcmp(res, tmp));
+  }
+  keys[0] = "missing";
+  keys[1] = NULL;
+  assert(swiss_table_insert_batch(tbl, keys, NULL, keys, NULL, 2, results) == INVALID_ARGS);
+  assert(results[0] == NO_ERR && results[1] == INVALID_ARGS);
+  assert(swiss_table_get_ref(tbl, "missing", NULL));
+  swiss_table_destroy(tbl);
+}
+
+static void
 strange_args_search_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
-  double start, end, total = 0;
-  int test_count = 0;
   char* res;
-  start = omp_get_wtime();
   res = swiss_table_get_copy(NULL, "123");
-  end = omp_get_wtime();
   assert(!res);
-  total += (end - start);
-  ++test_count;
-  start = omp_get_wtime();
   res = swiss_table_get_copy(tbl, NULL);
-  end = omp_get_wtime();
   assert(!res);
-  total += (end - start);
-  ++test_count;
-  start = omp_get_wtime();
   res = swiss_table_get_copy(tbl, "123");
-  end = omp_get_wtime();
   assert(!res);
-  total += (end - start);
-  ++test_count;
   swiss_table_destroy(tbl);
-  return total / test_count;
 }
 
-static double
+static void
 simple_delete_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
   const int iter_max = 100;
-  double start, end, total = 0;
   char tmp[10] = { 0 };
   int err;
   for (int i = 0; i < iter_max; ++i) {
@@ -189,23 +275,18 @@ simple_delete_test(void)
   }
   for (int i = 0; i < iter_max; ++i) {
     sprintf(tmp, "%d", i);
-    start = omp_get_wtime();
     err = swiss_table_delete(tbl, tmp);
-    end = omp_get_wtime();
     assert(err == NO_ERR);
-    total += (end - start);
   }
   swiss_table_destroy(tbl);
-  return total / iter_max;
 }
 
-static double
+static void
 huge_delete_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
   const int iter_max = 1000;
-  double start, end, total = 0;
   char tmp[10] = { 0 };
   int err;
   for (int i = 0; i < iter_max; ++i) {
@@ -215,44 +296,1107 @@ huge_delete_test(void)
   }
   for (int i = 0; i < iter_max; ++i) {
     sprintf(tmp, "%d", i);
-    start = omp_get_wtime();
     err = swiss_table_delete(tbl, tmp);
-    end = omp_get_wtime();
     assert(err == NO_ERR);
-    total += (end - start);
   }
   swiss_table_destroy(tbl);
-  return total / iter_max;
 }
 
-static double
+static void
 strange_args_delete_test(void)
 {
   swiss_table_t* tbl = swiss_table_init();
   assert(tbl);
-  double start, end, total = 0;
-  int test_count = 0;
   int err;
-  start = omp_get_wtime();
   err = swiss_table_delete(NULL, "123");
-  end = omp_get_wtime();
   assert(err == INVALID_ARGS);
-  total += (end - start);
-  ++test_count;
-  start = omp_get_wtime();
   err = swiss_table_delete(tbl, NULL);
-  end = omp_get_wtime();
   assert(err == INVALID_ARGS);
-  total += (end - start);
-  ++test_count;
-  start = omp_get_wtime();
   err = swiss_table_delete(tbl, "123");
-  end = omp_get_wtime();
   assert(err == KEY_NOT_FOUND);
-  total += (end - start);
-  ++test_count;
   swiss_table_destroy(tbl);
-  return total / test_count;
+}
+
+static void
+binary_keys_test(void)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  int err;
+  const char key_a[] = { 'k', '\0', 'a' };
+  const char key_b[] = { 'k', '\0', 'b' };
+  const char data[] = { 'd', '\0', 'd' };
+  size_t data_len = 0;
+  err = swiss_table_insert_update_n(tbl, key_a, sizeof(key_a), data, sizeof(data));
+  assert(err == NO_ERR);
+  err = swiss_table_insert_update_n(tbl, key_b, sizeof(key_b), "b", 1);
+  assert(err == NO_ERR);
+  char* res = swiss_table_get_copy_n(tbl, key_a, sizeof(key_a), &data_len);
+  assert(res);
+  assert(data_len == sizeof(data) && !memcmp(res, data, sizeof(data)));
+  free(res);
+  assert(!swiss_table_get_copy(tbl, "k"));
+  err = swiss_table_insert_update_n(tbl, "k", 1, "plain", 5);
+  assert(err == NO_ERR);
+  res = swiss_table_get_copy(tbl, "k");
+  assert(res && !strcmp(res, "plain"));
+  free(res);
+  err = swiss_table_delete_n(tbl, key_b, sizeof(key_b));
+  assert(err == NO_ERR);
+  assert(swiss_table_delete_n(tbl, key_b, sizeof(key_b)) == KEY_NOT_FOUND);
+  assert(swiss_table_delete(tbl, "k") == NO_ERR);
+  swiss_table_destroy(tbl);
+}
+
+static uint64_t
+user_hash(const char* key)
+{
+  uint64_t h = 14695981039346656037ull;
+  for (; *key; ++key) {
+    h = (h ^ (uint8_t)*key) * 1099511628211ull;
+  }
+  return h;
+}
+
+static void
+user_hash_test(void)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  swiss_table_set_hash(tbl, &user_hash);
+  const int iter_max = 1000;
+  char tmp[10] = { 0 };
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int err = swiss_table_insert_update(tbl, tmp, tmp);
+    assert(err == NO_ERR);
+  }
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    char* res = swiss_table_get_copy_n(tbl, tmp, strlen(tmp), NULL);
+    assert(res && !strcmp(res, tmp));
+    free(res);
+  }
+  swiss_table_destroy(tbl);
+}
+
+typedef struct
+{
+  size_t live_bytes;
+  size_t calls;
+} counting_ctx_t;
+
+static void*
+counting_alloc(void* ctx, size_t size, size_t align)
+{
+  counting_ctx_t* counter = (counting_ctx_t*)ctx;
+  counter->live_bytes += size;
+  ++counter->calls;
+  return align <= 16 ? malloc(size) : aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+static void
+counting_free(void* ctx, void* ptr, size_t size)
+{
+  ((counting_ctx_t*)ctx)->live_bytes -= size;
+  free(ptr);
+}
+
+static void
+arena_storage_test(void)
+{
+  counting_ctx_t counter = { 0, 0 };
+  swiss_table_options_t opts = { 0 };
+  opts.storage = SWISS_TABLE_STORAGE_ARENA;
+  opts.allocator.alloc = &counting_alloc;
+  opts.allocator.free = &counting_free;
+  opts.allocator.ctx = &counter;
+  swiss_table_t* tbl = swiss_table_init_opts(&opts);
+  assert(tbl);
+  const int iter_max = 100000;
+  char tmp[10] = { 0 };
+  char long_str[4096 + 1];
+  memset(long_str, 'x', sizeof(long_str) - 1);
+  long_str[sizeof(long_str) - 1] = '\0';
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int err = swiss_table_insert_update(tbl, tmp, i % 1000 ? tmp : long_str);
+    assert(err == NO_ERR);
+  }
+  assert(counter.calls < (size_t)iter_max);
+  for (int i = 0; i < iter_max; i += 2) {
+    sprintf(tmp, "%d", i);
+    assert(swiss_table_insert_update(tbl, tmp, "updated") == UPDATED);
+    sprintf(tmp, "%d", i + 1);
+    assert(swiss_table_delete(tbl, tmp) == NO_ERR);
+  }
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    const char* res = swiss_table_get_ref(tbl, tmp, NULL);
+    assert(i % 2 ? !res : res && !strcmp(res, "updated"));
+  }
+  swiss_table_destroy(tbl);
+  assert(counter.live_bytes == 0);
+}
+
+typedef struct
+{
+  size_t limit;
+} limit_ctx_t;
+
+/* Refuses every request larger than limit bytes. */
+static void*
+limit_alloc(void* ctx, size_t size, size_t align)
+{
+  if (size > ((limit_ctx_t*)ctx)->limit) {
+    return NULL;
+  }
+  return align <= 16 ? malloc(size) : aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+static void
+limit_free(void* ctx, void* ptr, size_t size)
+{
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+static void
+failing_alloc_test(void)
+{
+  /* Arena storage carves small blocks from chunks it already holds, so only a large value reaches the allocator. */
+  static char large_value[4096];
+  memset(large_value, 'v', sizeof(large_value) - 1);
+  const char* long_key = "a key longer than the limit";
+  for (uint8_t storage = SWISS_TABLE_STORAGE_HEAP; storage <= SWISS_TABLE_STORAGE_ARENA; ++storage) {
+    limit_ctx_t limit = { SIZE_MAX };
+    swiss_table_options_t opts = { 0 };
+    opts.storage = storage;
+    opts.allocator.alloc = &limit_alloc;
+    opts.allocator.free = &limit_free;
+    opts.allocator.ctx = &limit;
+    swiss_table_t* tbl = swiss_table_init_opts(&opts);
+    assert(tbl);
+    assert(swiss_table_insert_update(tbl, "kept", "old") == NO_ERR);
+    limit.limit = 10;
+    const char* value = storage == SWISS_TABLE_STORAGE_HEAP ? "a value longer than the limit" : large_value;
+    assert(swiss_table_insert_update(tbl, "short", value) == OUT_OF_MEMORY);
+    assert(!swiss_table_get_ref(tbl, "short", NULL));
+    assert(swiss_table_insert_update(tbl, "kept", value) == OUT_OF_MEMORY);
+    const char* ref = swiss_table_get_ref(tbl, "kept", NULL);
+    assert(ref && !strcmp(ref, "old"));
+    if (storage == SWISS_TABLE_STORAGE_HEAP) {
+      assert(swiss_table_insert_update(tbl, long_key, "v") == OUT_OF_MEMORY);
+      assert(!swiss_table_get_ref(tbl, long_key, NULL));
+      uint8_t results[2];
+      const char* keys[2] = { "batch", long_key };
+      const char* datas[2] = { "ok", "v" };
+      assert(swiss_table_insert_batch(tbl, keys, NULL, datas, NULL, 2, results) == OUT_OF_MEMORY);
+      assert(results[0] == NO_ERR && results[1] == OUT_OF_MEMORY);
+      assert(swiss_table_get_ref(tbl, "batch", NULL) && !swiss_table_get_ref(tbl, long_key, NULL));
+    }
+    limit.limit = SIZE_MAX;
+    assert(swiss_table_insert_update(tbl, long_key, value) == NO_ERR);
+    ref = swiss_table_get_ref(tbl, long_key, NULL);
+    assert(ref && !strcmp(ref, value));
+    swiss_table_destroy(tbl);
+  }
+}
+
+/* A table whose arrays cannot be doubled refuses new keys at its fill limit instead of filling up. */
+static void
+no_growth_test(void)
+{
+  for (uint8_t incremental = 0; incremental < 2; ++incremental) {
+    limit_ctx_t limit = { SIZE_MAX };
+    swiss_table_options_t opts = { 0 };
+    opts.incremental_resize = incremental;
+    opts.allocator.alloc = &limit_alloc;
+    opts.allocator.free = &limit_free;
+    opts.allocator.ctx = &limit;
+    swiss_table_t* tbl = swiss_table_init_opts(&opts);
+    assert(tbl);
+    swiss_table_stats_t stats;
+    assert(swiss_table_get_stats(tbl, &stats) == NO_ERR);
+    limit.limit = stats.slot_bytes;
+    const int iter_max = 4096;
+    char tmp[12];
+    int stored = 0;
+    for (int i = 0; i < iter_max; ++i) {
+      snprintf(tmp, sizeof(tmp), "%d", i);
+      uint8_t err = swiss_table_insert_update(tbl, tmp, tmp);
+      assert(err == NO_ERR || (err == OUT_OF_MEMORY && stored));
+      stored += err == NO_ERR;
+    }
+    assert(stored < iter_max && (size_t)stored < stats.capacity);
+    for (int i = 0; i < iter_max; ++i) {
+      snprintf(tmp, sizeof(tmp), "%d", i);
+      const char* ref = swiss_table_get_ref(tbl, tmp, NULL);
+      assert(i < stored ? ref && !strcmp(ref, tmp) : !ref);
+    }
+    /* An update of a full table neither tries to grow it nor purges tombstones. */
+    swiss_table_stats_t before, after;
+    assert(swiss_table_get_stats(tbl, &before) == NO_ERR);
+    assert(swiss_table_insert_update(tbl, "0", "updated") == UPDATED);
+    assert(swiss_table_get_stats(tbl, &after) == NO_ERR);
+    assert(after.resizes == before.resizes && after.compactions == before.compactions);
+    /* Deleting makes room again. */
+    assert(swiss_table_delete(tbl, "1") == NO_ERR);
+    assert(swiss_table_insert_update(tbl, "new", "new") == NO_ERR);
+    limit.limit = SIZE_MAX;
+    snprintf(tmp, sizeof(tmp), "%d", iter_max);
+    assert(swiss_table_insert_update(tbl, tmp, tmp) == NO_ERR);
+    swiss_table_destroy(tbl);
+  }
+}
+
+static void
+churn_test(void)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  const int iter_max = 500000;
+  const int window = 1000;
+  char tmp[10] = { 0 };
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int err = swiss_table_insert_update(tbl, tmp, tmp);
+    assert(err == NO_ERR);
+    if (i >= window) {
+      sprintf(tmp, "%d", i - window);
+      assert(swiss_table_delete(tbl, tmp) == NO_ERR);
+    }
+  }
+  for (int i = iter_max - window; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    const char* res = swiss_table_get_ref(tbl, tmp, NULL);
+    assert(res && !strcmp(res, tmp));
+  }
+  for (int i = iter_max - window; i < iter_max; i += 2) {
+    sprintf(tmp, "%d", i);
+    assert(swiss_table_delete(tbl, tmp) == NO_ERR);
+  }
+  assert(swiss_table_compact(tbl) == NO_ERR);
+  assert(swiss_table_compact(NULL) == INVALID_ARGS);
+  for (int i = iter_max - 2 * window; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    const char* res = swiss_table_get_ref(tbl, tmp, NULL);
+    assert(i < iter_max - window || i % 2 == 0 ? !res : res && !strcmp(res, tmp));
+  }
+  swiss_table_destroy(tbl);
+}
+
+static void
+reserve_test(void)
+{
+  assert(!swiss_table_init_with(10, 0.95f));
+  assert(!swiss_table_init_with(10, -1.0f));
+  swiss_table_t* tbl = swiss_table_init_with(1, 0.875f);
+  assert(tbl);
+  char tmp[10] = { 0 };
+  for (int i = 0; i < 200; ++i) {
+    sprintf(tmp, "%d", i);
+    assert(swiss_table_insert_update(tbl, tmp, tmp) == NO_ERR);
+  }
+  swiss_table_destroy(tbl);
+  tbl = swiss_table_init();
+  assert(tbl);
+  const int iter_max = 1000000;
+  assert(swiss_table_reserve(NULL, 1) == INVALID_ARGS);
+  assert(swiss_table_reserve(tbl, iter_max) == NO_ERR);
+  /* The reserved table takes every key without another rehash. */
+  swiss_table_stats_t reserved, stats;
+  assert(swiss_table_get_stats(tbl, &reserved) == NO_ERR);
+  assert(reserved.capacity * 0.7 >= iter_max);
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int err = swiss_table_insert_update(tbl, tmp, tmp);
+    assert(err == NO_ERR);
+  }
+  assert(swiss_table_get_stats(tbl, &stats) == NO_ERR);
+  assert(stats.capacity == reserved.capacity && stats.resizes == reserved.resizes && stats.compactions == reserved.compactions);
+  for (int i = 0; i < iter_max; ++i) {
+    if (i % 100) {
+      sprintf(tmp, "%d", i);
+      assert(swiss_table_delete(tbl, tmp) == NO_ERR);
+    }
+  }
+  assert(swiss_table_shrink_to_fit(tbl) == NO_ERR);
+  assert(swiss_table_get_stats(tbl, &stats) == NO_ERR);
+  assert(stats.capacity < reserved.capacity && stats.capacity * 0.7 >= iter_max / 100);
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    const char* res = swiss_table_get_ref(tbl, tmp, NULL);
+    assert(i % 100 ? !res : res && !strcmp(res, tmp));
+  }
+  swiss_table_destroy(tbl);
+}
+
+static void
+incremental_resize_test(void)
+{
+  swiss_table_options_t opts = { 0 };
+  opts.incremental_resize = 1;
+  swiss_table_t* tbl = swiss_table_init_opts(&opts);
+  assert(tbl);
+  const int iter_max = 1000000;
+  char tmp[10] = { 0 };
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int err = swiss_table_insert_update(tbl, tmp, tmp);
+    assert(err == NO_ERR);
+    if (i % 3 == 0) {
+      sprintf(tmp, "%d", i / 6 * 3);
+      assert(swiss_table_insert_update(tbl, tmp, "updated") == UPDATED);
+    } else if (i % 3 == 1) {
+      sprintf(tmp, "%d", i - 3);
+      assert(i < 3 || swiss_table_delete(tbl, tmp) == NO_ERR);
+    }
+    if (i % 1000 == 0) {
+      sprintf(tmp, "%d", i / 6 * 3);
+      assert(swiss_table_get_ref(tbl, tmp, NULL));
+    }
+  }
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    const char* res = swiss_table_get_ref(tbl, tmp, NULL);
+    assert(i % 3 == 1 && i < iter_max - 3 ? !res : res != NULL);
+  }
+  swiss_table_destroy(tbl);
+  opts.storage = SWISS_TABLE_STORAGE_ARENA;
+  tbl = swiss_table_init_opts(&opts);
+  assert(tbl);
+  for (int i = 0; i < 3000; ++i) {
+    sprintf(tmp, "%d", i);
+    assert(swiss_table_insert_update(tbl, tmp, tmp) == NO_ERR);
+  }
+  swiss_table_destroy(tbl);
+}
+
+static void
+count_visit(const char* key, size_t key_len, const char* data, size_t data_len, void* ctx)
+{
+  int* seen = (int*)ctx;
+  assert(key_len == strlen(key) && data_len == strlen(data) && !strcmp(key, data));
+  ++seen[atoi(key)];
+}
+
+static void
+iteration_test(void)
+{
+  const int iter_max = 100000;
+  int* seen = (int*)calloc(2 * iter_max, sizeof(int));
+  assert(seen);
+  char tmp[10] = { 0 };
+  for (uint8_t incremental = 0; incremental < 2; ++incremental) {
+    swiss_table_options_t opts = { 0 };
+    opts.incremental_resize = incremental;
+    swiss_table_t* tbl = swiss_table_init_opts(&opts);
+    assert(tbl);
+    for (int i = 0; i < iter_max; ++i) {
+      sprintf(tmp, "%d", i);
+      assert(swiss_table_insert_update(tbl, tmp, tmp) == NO_ERR);
+    }
+    swiss_table_iter_t iter;
+    const char* key;
+    size_t key_len = 0;
+    int count = 0;
+    swiss_table_iter_init(&iter, tbl);
+    while (swiss_table_iter_next(&iter, &key, &key_len, NULL, NULL)) {
+      assert(key_len == strlen(key));
+      ++count;
+    }
+    assert(count == iter_max);
+    assert(!swiss_table_iter_next(&iter, NULL, NULL, NULL, NULL));
+    memset(seen, 0, 2 * iter_max * sizeof(int));
+    swiss_table_foreach(tbl, &count_visit, seen);
+    for (int i = 0; i < iter_max; ++i) {
+      assert(seen[i] == 1);
+    }
+    memset(seen, 0, 2 * iter_max * sizeof(int));
+    uint64_t cursor = 0;
+    do {
+      cursor = swiss_table_scan(tbl, cursor, 16, &count_visit, seen);
+    } while (cursor);
+    for (int i = 0; i < iter_max; ++i) {
+      assert(seen[i] == 1);
+    }
+    /* Grow the table and churn unrelated keys between scan calls. */
+    memset(seen, 0, 2 * iter_max * sizeof(int));
+    int next = iter_max;
+    do {
+      cursor = swiss_table_scan(tbl, cursor, 4, &count_visit, seen);
+      for (int i = 0; i < 64 && next < 2 * iter_max; ++i, ++next) {
+        sprintf(tmp, "%d", next);
+        assert(swiss_table_insert_update(tbl, tmp, tmp) == NO_ERR);
+        if (next % 3 == 0) {
+          assert(swiss_table_delete(tbl, tmp) == NO_ERR);
+        }
+      }
+    } while (cursor);
+    for (int i = 0; i < iter_max; ++i) {
+      assert(seen[i] >= 1);
+    }
+    swiss_table_destroy(tbl);
+  }
+  swiss_table_iter_t iter;
+  swiss_table_iter_init(&iter, NULL);
+  assert(!swiss_table_iter_next(&iter, NULL, NULL, NULL, NULL));
+  assert(swiss_table_scan(NULL, 0, 1, &count_visit, seen) == 0);
+  free(seen);
+}
+
+static void
+build_from_test(void)
+{
+  const int iter_max = 300000;
+  const int key_max = 200000;
+  char (*keys_buf)[10] = malloc(iter_max * sizeof(*keys_buf));
+  char (*datas_buf)[10] = malloc(iter_max * sizeof(*datas_buf));
+  const char** keys = malloc(iter_max * sizeof(*keys));
+  const char** datas = malloc(iter_max * sizeof(*datas));
+  assert(keys_buf && datas_buf && keys && datas);
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(keys_buf[i], "%d", i % key_max);
+    sprintf(datas_buf[i], "%d", i);
+    keys[i] = keys_buf[i];
+    datas[i] = datas_buf[i];
+  }
+  swiss_table_t* tbl = swiss_table_build_from(NULL, keys, NULL, datas, NULL, iter_max);
+  assert(tbl);
+  char buf[10];
+  for (int i = 0; i < key_max; ++i) {
+    char expected[10];
+    sprintf(expected, "%d", i + key_max < iter_max ? i + key_max : i);
+    assert(swiss_table_get_into(tbl, keys[i], buf, sizeof(buf), NULL) == NO_ERR);
+    assert(!strcmp(buf, expected));
+  }
+  assert(swiss_table_insert_update(tbl, "0", "x") == UPDATED);
+  assert(swiss_table_insert_update(tbl, "new", "x") == NO_ERR);
+  for (int i = 0; i < key_max; i += 2) {
+    assert(swiss_table_delete(tbl, keys[i]) == NO_ERR);
+  }
+  swiss_table_destroy(tbl);
+  swiss_table_options_t opts = { 0 };
+  opts.storage = SWISS_TABLE_STORAGE_ARENA;
+  tbl = swiss_table_build_from(&opts, keys, NULL, datas, NULL, 3);
+  assert(tbl);
+  assert(swiss_table_get_into(tbl, "2", buf, sizeof(buf), NULL) == NO_ERR && !strcmp(buf, "2"));
+  swiss_table_destroy(tbl);
+  tbl = swiss_table_build_from(NULL, NULL, NULL, NULL, NULL, 0);
+  assert(tbl);
+  swiss_table_destroy(tbl);
+  keys[1] = NULL;
+  assert(!swiss_table_build_from(NULL, keys, NULL, datas, NULL, iter_max));
+  assert(!swiss_table_build_from(NULL, NULL, NULL, datas, NULL, 1));
+  free(keys_buf);
+  free(datas_buf);
+  free(keys);
+  free(datas);
+}
+
+/*
+ * The parallel backend's partitioned place_all only runs with more than
+ * one OpenMP thread and at least 65536 (PARALLEL_MIN_ENTRIES) entries, so
+ * force both. Duplicates check that the highest index wins; the high
+ * fill pushes probes over partition edges into the serial pass, and the
+ * reserve runs the same path again without dedup.
+ */
+static void
+parallel_build_test(void)
+{
+  const int iter_max = 200000;
+  const int key_max = 150000;
+  int threads = omp_get_max_threads();
+  omp_set_num_threads(4);
+  char (*keys_buf)[32] = malloc(iter_max * sizeof(*keys_buf));
+  char (*datas_buf)[12] = malloc(iter_max * sizeof(*datas_buf));
+  const char** keys = malloc(iter_max * sizeof(*keys));
+  const char** datas = malloc(iter_max * sizeof(*datas));
+  assert(keys_buf && datas_buf && keys && datas);
+  for (int i = 0; i < iter_max; ++i) {
+    snprintf(keys_buf[i], sizeof(keys_buf[i]), i % key_max % 3 ? "%d" : "a-long-parallel-key-%d", i % key_max);
+    snprintf(datas_buf[i], sizeof(datas_buf[i]), "%d", i);
+    keys[i] = keys_buf[i];
+    datas[i] = datas_buf[i];
+  }
+  swiss_table_options_t opts = { 0 };
+  opts.backend = SWISS_TABLE_BACKEND_PARALLEL;
+  opts.max_load = 0.875;
+  swiss_table_t* tbl = swiss_table_build_from(&opts, keys, NULL, datas, NULL, iter_max);
+  assert(tbl && swiss_table_get_backend(tbl) == SWISS_TABLE_BACKEND_PARALLEL);
+  char buf[12];
+  for (int round = 0; round < 2; ++round) {
+    size_t count = 0;
+    swiss_table_iter_t iter;
+    swiss_table_iter_init(&iter, tbl);
+    while (swiss_table_iter_next(&iter, NULL, NULL, NULL, NULL)) {
+      ++count;
+    }
+    assert(count == (size_t)key_max);
+    for (int i = 0; i < key_max; ++i) {
+      char expected[12];
+      snprintf(expected, sizeof(expected), "%d", i + key_max < iter_max ? i + key_max : i);
+      assert(swiss_table_get_into(tbl, keys[i], buf, sizeof(buf), NULL) == NO_ERR);
+      assert(!strcmp(buf, expected));
+    }
+    assert(swiss_table_reserve(tbl, 4 * (size_t)iter_max) == NO_ERR);
+  }
+  swiss_table_destroy(tbl);
+
+  /* Copies refused mid-build are undone slot by slot before the table is destroyed. */
+  size_t huge_len = 1 << 20;
+  char* huge = malloc(huge_len + 1);
+  assert(huge);
+  memset(huge, 'h', huge_len);
+  huge[huge_len] = '\0';
+  limit_ctx_t limit = { huge_len / 2 };
+  opts.allocator.alloc = &limit_alloc;
+  opts.allocator.free = &limit_free;
+  opts.allocator.ctx = &limit;
+  const char* failing_keys[] = { "a-long-key-that-is-copied", huge, "short", "another-long-copied-key" };
+  const char* failing_datas[] = { "kept", "value", huge, "kept" };
+  assert(!swiss_table_build_from(&opts, failing_keys, NULL, failing_datas, NULL, 4));
+  free(huge);
+  omp_set_num_threads(threads);
+  free(keys_buf);
+  free(datas_buf);
+  free(keys);
+  free(datas);
+}
+
+SWISS_TABLE_DEFINE_U64(u64_map, uint64_t)
+
+typedef struct point
+{
+  int32_t x;
+  int32_t y;
+} point_t;
+
+static inline uint64_t
+point_hash(point_t point)
+{
+  return swiss_table_hash_u64(((uint64_t)(uint32_t)point.x << 32) | (uint32_t)point.y);
+}
+
+static inline int
+point_eq(point_t lhs, point_t rhs)
+{
+  return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+
+SWISS_TABLE_DEFINE(point_map, point_t, double, point_hash, point_eq)
+
+static void
+generic_table_test(void)
+{
+  assert(sizeof(u64_map_slot_t) == 16);
+  u64_map_t* tbl = u64_map_init();
+  assert(tbl);
+  const uint64_t iter_max = 1000000;
+  for (uint64_t i = 0; i < iter_max; ++i) {
+    assert(u64_map_insert_update(tbl, i * 3, i) == NO_ERR);
+  }
+  assert(u64_map_size(tbl) == iter_max);
+  for (uint64_t i = 0; i < iter_max; ++i) {
+    uint64_t* value = u64_map_get(tbl, i * 3);
+    assert(value && *value == i);
+    assert(!u64_map_get(tbl, i * 3 + 1));
+  }
+  assert(u64_map_insert_update(tbl, 0, 7) == UPDATED);
+  assert(*u64_map_get(tbl, 0) == 7);
+  for (uint64_t round = 0; round < 4; ++round) {
+    for (uint64_t i = 0; i < iter_max; i += 2) {
+      assert(u64_map_delete(tbl, i * 3) == NO_ERR);
+    }
+    assert(u64_map_delete(tbl, 3 * iter_max) == KEY_NOT_FOUND);
+    for (uint64_t i = 0; i < iter_max; i += 2) {
+      assert(u64_map_insert_update(tbl, i * 3, i) == NO_ERR);
+    }
+  }
+  uint64_t sum = 0;
+  uint32_t cursor = 0;
+  size_t visited = 0;
+  for (u64_map_slot_t* slot; (slot = u64_map_next(tbl, &cursor)); ++visited) {
+    sum += slot->value;
+  }
+  assert(visited == iter_max && sum == iter_max * (iter_max - 1) / 2);
+  u64_map_destroy(tbl);
+
+  point_map_t* points = point_map_init_with(1000);
+  assert(points);
+  for (int32_t x = -20; x < 20; ++x) {
+    for (int32_t y = -20; y < 20; ++y) {
+      point_t point = { x, y };
+      assert(point_map_insert_update(points, point, x * 0.5 + y) == NO_ERR);
+    }
+  }
+  point_t point = { -3, 4 };
+  assert(point_map_get(points, point) && *point_map_get(points, point) == 2.5);
+  point.x = 20;
+  assert(!point_map_get(points, point));
+  assert(point_map_reserve(points, 100000) == NO_ERR && point_map_size(points) == 1600);
+  assert(point_map_insert_update(NULL, point, 0) == INVALID_ARGS);
+  point_map_destroy(points);
+}
+
+static void
+set_test(void)
+{
+  swiss_set_t* set = swiss_set_init();
+  assert(set);
+  const int iter_max = 1000000;
+  char tmp[16];
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int err = swiss_set_insert(set, tmp);
+    assert(err == NO_ERR);
+  }
+  assert(swiss_set_insert(set, "17") == UPDATED);
+  assert(swiss_set_size(set) == (size_t)iter_max);
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    assert(swiss_set_contains(set, tmp));
+    sprintf(tmp, "-%d", i + 1);
+    assert(!swiss_set_contains(set, tmp));
+  }
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < iter_max; i += 2) {
+      sprintf(tmp, "%d", i);
+      assert(swiss_set_erase(set, tmp) == NO_ERR);
+      assert(swiss_set_erase(set, tmp) == KEY_NOT_FOUND);
+    }
+    for (int i = 0; i < iter_max; i += 2) {
+      sprintf(tmp, "%d", i);
+      assert(swiss_set_insert(set, tmp) == NO_ERR);
+    }
+  }
+  assert(swiss_set_size(set) == (size_t)iter_max);
+  assert(swiss_set_insert_n(set, "a\0b", 3) == NO_ERR);
+  assert(swiss_set_contains_n(set, "a\0b", 3) && !swiss_set_contains(set, "a"));
+  assert(swiss_set_erase_n(set, "a\0b", 3) == NO_ERR);
+  swiss_set_destroy(set);
+
+  swiss_table_options_t opts = { 0 };
+  opts.storage = SWISS_TABLE_STORAGE_ARENA;
+  opts.capacity = 1000;
+  set = swiss_set_init_opts(&opts);
+  assert(set);
+  for (int i = 0; i < 5000; ++i) {
+    sprintf(tmp, "%d", i);
+    assert(swiss_set_insert(set, tmp) == NO_ERR);
+  }
+  assert(swiss_set_contains(set, "4999"));
+  swiss_set_destroy(set);
+  assert(swiss_set_insert(NULL, "k") == INVALID_ARGS);
+  assert(!swiss_set_contains(NULL, "k"));
+  assert(swiss_set_erase(NULL, "k") == INVALID_ARGS);
+  opts.max_load = 0.95f;
+  assert(!swiss_set_init_opts(&opts));
+
+  /* Like the map, a set that cannot grow refuses new keys at its fill limit. */
+  limit_ctx_t limit = { SIZE_MAX };
+  swiss_table_options_t limited = { 0 };
+  limited.capacity = 1000;
+  limited.allocator.alloc = &limit_alloc;
+  limited.allocator.free = &limit_free;
+  limited.allocator.ctx = &limit;
+  set = swiss_set_init_opts(&limited);
+  assert(set);
+  /* 1000 entries at 0.7 take 2048 slots of 16 bytes; doubling is refused. */
+  limit.limit = 2048 * 16;
+  int stored = 0;
+  for (int i = 0; i < 4096; ++i) {
+    sprintf(tmp, "%d", i);
+    uint8_t err = swiss_set_insert(set, tmp);
+    assert(err == NO_ERR || (err == OUT_OF_MEMORY && stored));
+    stored += err == NO_ERR;
+  }
+  assert(stored == (int)(2048 * 0.7f) + 1 && swiss_set_size(set) == (size_t)stored);
+  assert(swiss_set_insert(set, "0") == UPDATED);
+  assert(swiss_set_erase(set, "1") == NO_ERR);
+  assert(swiss_set_insert(set, "new") == NO_ERR);
+  assert(swiss_set_contains(set, "new") && swiss_set_contains(set, "2"));
+  swiss_set_destroy(set);
+}
+
+static void
+key_length_test(void)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  const int len_max = 40;
+  const int iter_max = 1000;
+  char key[64];
+  for (int i = 0; i < iter_max; ++i) {
+    int len = i % len_max;
+    memset(key, 'a' + i % 26, len);
+    if (len > 4) {
+      sprintf(key, "%d", i);
+      key[strlen(key)] = '\0' + (len == 15 || len == 16);
+    }
+    int err = swiss_table_insert_update_n(tbl, key, len, key, len);
+    assert(err == NO_ERR || (len <= 4 && err == UPDATED));
+    size_t data_len = 0;
+    const char* res = swiss_table_get_ref_n(tbl, key, len, &data_len);
+    assert(res && data_len == (size_t)len && !memcmp(res, key, len));
+  }
+  swiss_table_iter_t iter;
+  swiss_table_iter_init(&iter, tbl);
+  const char* iter_key;
+  const char* iter_data;
+  size_t iter_key_len, iter_data_len;
+  while (swiss_table_iter_next(&iter, &iter_key, &iter_key_len, &iter_data, &iter_data_len)) {
+    assert(iter_key_len == iter_data_len && !memcmp(iter_key, iter_data, iter_key_len));
+    assert(iter_key[iter_key_len] == '\0');
+  }
+  assert(swiss_table_shrink_to_fit(tbl) == NO_ERR);
+  for (int i = 0; i < iter_max; ++i) {
+    int len = i % len_max;
+    if (len > 4) {
+      memset(key, 'a' + i % 26, len);
+      sprintf(key, "%d", i);
+      key[strlen(key)] = '\0' + (len == 15 || len == 16);
+      assert(swiss_table_delete_n(tbl, key, len) == NO_ERR);
+      assert(!swiss_table_get_ref_n(tbl, key, len, NULL));
+    }
+  }
+  swiss_table_destroy(tbl);
+}
+
+static void
+snapshot_test(void)
+{
+  const char* path = "swiss_table_test.snapshot";
+  swiss_table_options_t opts = { 0 };
+  opts.incremental_resize = 1;
+  swiss_table_t* tbl = swiss_table_init_opts(&opts);
+  assert(tbl);
+  const int iter_max = 100000;
+  char key[40];
+  char data[40];
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(key, i % 3 ? "%d" : "a-rather-long-key-%d", i);
+    sprintf(data, "v%d", i);
+    assert(swiss_table_insert_update(tbl, key, data) == NO_ERR);
+  }
+  for (int i = 0; i < iter_max; i += 4) {
+    sprintf(key, i % 3 ? "%d" : "a-rather-long-key-%d", i);
+    assert(swiss_table_delete(tbl, key) == NO_ERR);
+  }
+  assert(swiss_table_insert_update_n(tbl, "b\0in", 4, "x\0y", 3) == NO_ERR);
+  assert(swiss_table_save(tbl, path) == NO_ERR);
+  swiss_table_mapped_t* mapped = swiss_table_open_mmap(path);
+  assert(mapped);
+  assert(swiss_table_mapped_size(mapped) == (size_t)(iter_max - iter_max / 4 + 1));
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(key, i % 3 ? "%d" : "a-rather-long-key-%d", i);
+    sprintf(data, "v%d", i);
+    size_t data_len = 0;
+    const char* res = swiss_table_mapped_get_ref(mapped, key, &data_len);
+    assert(i % 4 ? res && data_len == strlen(data) && !strcmp(res, data) : !res);
+  }
+  size_t data_len = 0;
+  const char* res = swiss_table_mapped_get_ref_n(mapped, "b\0in", 4, &data_len);
+  assert(res && data_len == 3 && !memcmp(res, "x\0y", 4));
+  assert(!swiss_table_mapped_get_ref(mapped, "b", NULL));
+  /* Replacing the file leaves the open mapping intact. */
+  swiss_table_destroy(tbl);
+  tbl = swiss_table_init();
+  assert(swiss_table_insert_update(tbl, "only", "one") == NO_ERR);
+  assert(swiss_table_save(tbl, path) == NO_ERR);
+  assert(swiss_table_mapped_get_ref(mapped, "1", NULL));
+  swiss_table_mapped_close(mapped);
+  mapped = swiss_table_open_mmap(path);
+  assert(mapped && swiss_table_mapped_size(mapped) == 1);
+  assert(!strcmp(swiss_table_mapped_get_ref(mapped, "only", NULL), "one"));
+  swiss_table_mapped_close(mapped);
+  swiss_table_destroy(tbl);
+
+  /* A control offset whose sum with the control size wraps to 0. */
+  FILE* file = fopen(path, "r+b");
+  assert(file);
+  uint32_t group_count;
+  uint64_t control_offset, wrapped;
+  assert(fseek(file, 12, SEEK_SET) == 0 && fread(&group_count, sizeof(group_count), 1, file) == 1);
+  assert(fseek(file, 32, SEEK_SET) == 0 && fread(&control_offset, sizeof(control_offset), 1, file) == 1);
+  wrapped = 0 - ((uint64_t)group_count * 16 + 16);
+  assert(fseek(file, 32, SEEK_SET) == 0 && fwrite(&wrapped, sizeof(wrapped), 1, file) == 1);
+  fclose(file);
+  assert(!swiss_table_open_mmap(path));
+  file = fopen(path, "r+b");
+  assert(file);
+  assert(fseek(file, 32, SEEK_SET) == 0 && fwrite(&control_offset, sizeof(control_offset), 1, file) == 1);
+  fclose(file);
+  mapped = swiss_table_open_mmap(path);
+  assert(mapped);
+  swiss_table_mapped_close(mapped);
+
+  file = fopen(path, "r+b");
+  assert(file);
+  assert(fseek(file, 0, SEEK_END) == 0);
+  long size = ftell(file);
+  fclose(file);
+  assert(truncate(path, size - 1) == 0);
+  assert(!swiss_table_open_mmap(path));
+  assert(remove(path) == 0);
+  assert(!swiss_table_open_mmap(path));
+  assert(swiss_table_save(NULL, path) == INVALID_ARGS);
+  tbl = swiss_table_init();
+  assert(swiss_table_save(tbl, "missing-directory/snapshot") == IO_ERROR);
+  swiss_table_destroy(tbl);
+  swiss_table_mapped_close(NULL);
+}
+
+typedef struct stream_buf
+{
+  char* _data;
+  size_t _size;
+  size_t _pos;
+  size_t _cap;
+} stream_buf_t;
+
+static size_t
+stream_write(void* ctx, const void* buf, size_t len)
+{
+  stream_buf_t* stream = (stream_buf_t*)ctx;
+  if (stream->_size + len > stream->_cap) {
+    return 0;
+  }
+  memcpy(stream->_data + stream->_size, buf, len);
+  stream->_size += len;
+  return len;
+}
+
+/* Hands out at most 1000 bytes per call to exercise partial reads. */
+static size_t
+stream_read(void* ctx, void* buf, size_t len)
+{
+  stream_buf_t* stream = (stream_buf_t*)ctx;
+  size_t left = stream->_size - stream->_pos;
+  len = len < left ? len : left;
+  len = len < 1000 ? len : 1000;
+  memcpy(buf, stream->_data + stream->_pos, len);
+  stream->_pos += len;
+  return len;
+}
+
+static void
+stream_test(void)
+{
+  swiss_table_t* tbl = swiss_table_init();
+  assert(tbl);
+  const int iter_max = 100000;
+  char key[40];
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(key, i % 5 ? "%d" : "a-long-streamed-key-%d", i);
+    assert(swiss_table_insert_update(tbl, key, key) == NO_ERR);
+  }
+  size_t big_len = 200000;
+  char* big = malloc(big_len);
+  assert(big);
+  for (size_t i = 0; i < big_len; ++i) {
+    big[i] = (char)i;
+  }
+  assert(swiss_table_insert_update_n(tbl, "big", 3, big, big_len) == NO_ERR);
+  stream_buf_t stream = { 0 };
+  stream._cap = 8 * 1024 * 1024;
+  stream._data = malloc(stream._cap);
+  assert(stream._data);
+  assert(swiss_table_write_stream(tbl, &stream_write, &stream) == NO_ERR);
+  swiss_table_t* copy = swiss_table_init();
+  assert(copy);
+  assert(swiss_table_read_stream(copy, &stream_read, &stream) == NO_ERR);
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(key, i % 5 ? "%d" : "a-long-streamed-key-%d", i);
+    const char* res = swiss_table_get_ref(copy, key, NULL);
+    assert(res && !strcmp(res, key));
+  }
+  size_t data_len = 0;
+  const char* res = swiss_table_get_ref_n(copy, "big", 3, &data_len);
+  assert(res && data_len == big_len && !memcmp(res, big, big_len));
+  swiss_table_destroy(copy);
+
+  /* Any flipped byte is caught before its block is inserted. */
+  for (size_t flip = 0; flip < stream._size; flip += stream._size / 97) {
+    stream._data[flip] ^= 0x20;
+    stream._pos = 0;
+    copy = swiss_table_init();
+    assert(copy);
+    int err = swiss_table_read_stream(copy, &stream_read, &stream);
+    assert(err == CORRUPT_DATA || err == IO_ERROR);
+    swiss_table_iter_t iter;
+    swiss_table_iter_init(&iter, copy);
+    const char* iter_key;
+    const char* iter_data;
+    size_t iter_key_len, iter_data_len;
+    while (swiss_table_iter_next(&iter, &iter_key, &iter_key_len, &iter_data, &iter_data_len)) {
+      assert((iter_key_len == 3 && iter_data_len == big_len) || (iter_key_len == iter_data_len && !memcmp(iter_key, iter_data, iter_key_len)));
+    }
+    swiss_table_destroy(copy);
+    stream._data[flip] ^= 0x20;
+  }
+  /* A first block claiming one 8 GiB entry fails its header CRC before any allocation. */
+  char saved[12];
+  memcpy(saved, stream._data + 28, sizeof(saved));
+  uint64_t huge_len = 8ull << 30;
+  uint32_t one = 1;
+  memcpy(stream._data + 28, &huge_len, sizeof(huge_len));
+  memcpy(stream._data + 36, &one, sizeof(one));
+  stream._pos = 0;
+  copy = swiss_table_init();
+  assert(swiss_table_read_stream(copy, &stream_read, &stream) == CORRUPT_DATA);
+  swiss_table_iter_t empty_iter;
+  swiss_table_iter_init(&empty_iter, copy);
+  assert(!swiss_table_iter_next(&empty_iter, NULL, NULL, NULL, NULL));
+  swiss_table_destroy(copy);
+  memcpy(stream._data + 28, saved, sizeof(saved));
+  stream._pos = 0;
+  stream._size -= 1;
+  copy = swiss_table_init();
+  assert(swiss_table_read_stream(copy, &stream_read, &stream) == IO_ERROR);
+  swiss_table_destroy(copy);
+  stream._size = 0;
+  stream._cap = 100;
+  assert(swiss_table_write_stream(tbl, &stream_write, &stream) == IO_ERROR);
+  assert(swiss_table_write_stream(NULL, &stream_write, &stream) == INVALID_ARGS);
+  assert(swiss_table_read_stream(tbl, NULL, &stream) == INVALID_ARGS);
+  swiss_table_destroy(tbl);
+
+  /* Stream buffers come from the table's allocator, which refuses a whole block here. */
+  limit_ctx_t limit = { SIZE_MAX };
+  swiss_table_options_t opts = { 0 };
+  opts.allocator.alloc = &limit_alloc;
+  opts.allocator.free = &limit_free;
+  opts.allocator.ctx = &limit;
+  tbl = swiss_table_init_opts(&opts);
+  assert(tbl);
+  assert(swiss_table_insert_update(tbl, "only", "entry") == NO_ERR);
+  stream._size = 0;
+  stream._pos = 0;
+  stream._cap = 8 * 1024 * 1024;
+  assert(swiss_table_write_stream(tbl, &stream_write, &stream) == NO_ERR);
+  limit.limit = 1024;
+  size_t written = stream._size;
+  stream._size = 0;
+  assert(swiss_table_write_stream(tbl, &stream_write, &stream) == OUT_OF_MEMORY);
+  stream._size = written;
+  assert(swiss_table_read_stream(tbl, &stream_read, &stream) == OUT_OF_MEMORY);
+  limit.limit = SIZE_MAX;
+  stream._pos = 0;
+  assert(swiss_table_read_stream(tbl, &stream_read, &stream) == NO_ERR);
+  const char* only = swiss_table_get_ref(tbl, "only", NULL);
+  assert(only && !strcmp(only, "entry"));
+  swiss_table_destroy(tbl);
+  free(stream._data);
+  free(big);
+}
+
+static void
+backend_test(void)
+{
+  assert(!swiss_table_init_ex(SWISS_TABLE_BACKEND_PARALLEL + 1));
+  assert(!swiss_table_backend_name(SWISS_TABLE_BACKEND_PARALLEL + 1));
+  assert(!strcmp(swiss_table_backend_name(SWISS_TABLE_BACKEND_AUTO), "auto"));
+  swiss_table_t* automatic = swiss_table_init();
+  assert(automatic && swiss_table_get_backend(automatic) != SWISS_TABLE_BACKEND_AUTO);
+  swiss_table_destroy(automatic);
+  /* Tables of every backend side by side, fed the same operations. */
+  const int iter_max = 50000;
+  swiss_table_t* tbls[3];
+  swiss_set_t* sets[3];
+  for (uint8_t backend = SWISS_TABLE_BACKEND_CONS; backend <= SWISS_TABLE_BACKEND_PARALLEL; ++backend) {
+    swiss_table_options_t opts = { 0 };
+    opts.backend = backend;
+    opts.incremental_resize = backend == SWISS_TABLE_BACKEND_SIMD;
+    tbls[backend - 1] = swiss_table_init_opts(&opts);
+    sets[backend - 1] = swiss_set_init_opts(&opts);
+    assert(tbls[backend - 1] && sets[backend - 1]);
+    assert(swiss_table_get_backend(tbls[backend - 1]) == backend);
+    assert(!strcmp(swiss_table_backend_name(backend), backend == SWISS_TABLE_BACKEND_CONS ? "cons" : backend == SWISS_TABLE_BACKEND_SIMD ? "simd" : "parallel"));
+  }
+  char tmp[16];
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    for (int index = 0; index < 3; ++index) {
+      assert(swiss_table_insert_update(tbls[index], tmp, tmp) == NO_ERR);
+      assert(swiss_set_insert(sets[index], tmp) == NO_ERR);
+      if (i % 3 == 0) {
+        sprintf(tmp, "%d", i / 3);
+        assert(swiss_table_delete(tbls[index], tmp) == NO_ERR);
+        assert(swiss_set_erase(sets[index], tmp) == NO_ERR);
+        sprintf(tmp, "%d", i);
+      }
+    }
+  }
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(tmp, "%d", i);
+    int present = i >= (iter_max + 2) / 3;
+    for (int index = 0; index < 3; ++index) {
+      const char* ref = swiss_table_get_ref(tbls[index], tmp, NULL);
+      assert(present ? ref && !strcmp(ref, tmp) : !ref);
+      assert(swiss_set_contains(sets[index], tmp) == present);
+    }
+  }
+  for (int index = 0; index < 3; ++index) {
+    swiss_table_destroy(tbls[index]);
+    swiss_set_destroy(sets[index]);
+  }
+}
+
+static void
+stats_test(void)
+{
+  swiss_table_stats_t stats;
+  swiss_table_t* tbl = swiss_table_init();
+  assert(swiss_table_get_stats(NULL, &stats) == INVALID_ARGS);
+  assert(swiss_table_get_stats(tbl, NULL) == INVALID_ARGS);
+  assert(swiss_table_get_stats(tbl, &stats) == NO_ERR);
+  assert(stats.size == 0 && stats.capacity > 0 && stats.load_factor == 0);
+  assert(stats.resizes == 0 && stats.compactions == 0 && stats.string_bytes == 0);
+  assert(stats.control_bytes > stats.capacity && stats.slot_bytes % stats.capacity == 0);
+  const int iter_max = 10000;
+  const char* long_key = "a key stored out of line";
+  char key[16], data[16];
+  size_t string_bytes = strlen(long_key) + 1 + 2;
+  assert(swiss_table_insert_update(tbl, long_key, "x") == NO_ERR);
+  for (int i = 0; i < iter_max; ++i) {
+    sprintf(key, "k%d", i);
+    sprintf(data, "%d", i);
+    assert(swiss_table_insert_update(tbl, key, data) == NO_ERR);
+    string_bytes += strlen(data) + 1;
+  }
+  for (int i = 0; i < 2 * iter_max; ++i) {
+    sprintf(key, "k%d", i);
+    assert(!swiss_table_get_ref(tbl, key, NULL) == (i >= iter_max));
+  }
+  assert(swiss_table_get_stats(tbl, &stats) == NO_ERR);
+  assert(stats.size == (size_t)iter_max + 1 && stats.resizes > 0);
+  assert(stats.load_factor == (double)stats.size / stats.capacity && stats.load_factor <= 0.875);
+  assert(stats.string_bytes == string_bytes);
+  uint64_t probes = 0;
+  for (int bucket = 0; bucket < SWISS_TABLE_PROBE_BUCKETS; ++bucket) {
+    probes += stats.probe_groups[bucket];
+  }
+  if (stats.counters_enabled) {
+    /* Every insert and lookup probed at least once; each hit matched its tag. */
+    assert(probes >= 3 * (uint64_t)iter_max);
+    assert(stats.tag_hits >= (uint64_t)iter_max && stats.tag_false_positives <= stats.tag_hits);
+  } else {
+    assert(!probes && !stats.tag_hits && !stats.tag_false_positives);
+  }
+  for (int i = 0; i < iter_max; i += 2) {
+    sprintf(key, "k%d", i);
+    assert(swiss_table_delete(tbl, key) == NO_ERR);
+  }
+  assert(swiss_table_get_stats(tbl, &stats) == NO_ERR);
+  assert(stats.size == (size_t)iter_max / 2 + 1 && stats.tombstones > 0);
+  assert(stats.tombstone_ratio == (double)stats.tombstones / stats.capacity);
+  assert(swiss_table_compact(tbl) == NO_ERR);
+  assert(swiss_table_get_stats(tbl, &stats) == NO_ERR);
+  assert(stats.tombstones == 0 && stats.compactions == 1);
+  swiss_table_destroy(tbl);
 }
 
 int
@@ -260,27 +1404,78 @@ main(int argc, char** argv)
 {
   (void)argc;
   (void)argv;
-  double time;
   printf("=======Tests started=======\n\n");
 
-  time = simple_insert_test();
-  printf("Simple insert test passed\nAvg. insertion time: %.15lf\n\n", time);
-  time = huge_insert_test();
-  printf("Huge insert test passed\nAvg. insertion time: %.15lf\n\n", time);
-  time = strange_args_insert_test();
-  printf("Strange argument insert test passed\nAvg. insertion time: %.15lf\n\n", time);
-  time = simple_search_test();
-  printf("Simple search test passed\nAvg. search time: %.15lf\n\n", time);
-  time = huge_search_test();
-  printf("Huge search test passed\nAvg. search time: %.15lf\n\n", time);
-  time = strange_args_search_test();
-  printf("Strange argument search test passed\nAvg. search time: %.15lf\n\n", time);
-  time = simple_delete_test();
-  printf("Stimple delete test passed\nAvg. delete time: %.15lf\n\n", time);
-  time = huge_delete_test();
-  printf("Huge delete test passed\nAvg. delete time: %.15lf\n\n", time);
-  time = strange_args_delete_test();
-  printf("Strange argument delete test passed\nAvg. delete time: %.15lf\n\n", time);
+  simple_insert_test();
+  printf("Simple insert test passed\n");
+  huge_insert_test();
+  printf("Huge insert test passed\n");
+  million_insert_test();
+  printf("Million insert test passed\n");
+  strange_args_insert_test();
+  printf("Strange argument insert test passed\n");
+  simple_search_test();
+  printf("Simple search test passed\n");
+  huge_search_test();
+  printf("Huge search test passed\n");
+  swiss_table_t* million = numbered_table(MILLION);
+  million_search_test(million);
+  printf("Million search test passed\n");
+  million_search_ref_test(million);
+  printf("Million borrowed search test passed\n");
+  million_search_into_test(million);
+  printf("Million buffer search test passed\n");
+  million_search_batch_test(million);
+  printf("Million batch search test passed\n");
+  swiss_table_destroy(million);
+  insert_batch_test();
+  printf("Batch insert test passed\n");
+  strange_args_search_test();
+  printf("Strange argument search test passed\n");
+  simple_delete_test();
+  printf("Stimple delete test passed\n");
+  huge_delete_test();
+  printf("Huge delete test passed\n");
+  strange_args_delete_test();
+  printf("Strange argument delete test passed\n");
+
+  binary_keys_test();
+  printf("Binary keys test passed\n");
+  user_hash_test();
+  printf("User hash test passed\n");
+
+  arena_storage_test();
+  printf("Arena storage test passed\n");
+  failing_alloc_test();
+  printf("Failing allocator test passed\n");
+  no_growth_test();
+  printf("No growth test passed\n");
+  churn_test();
+  printf("Churn test passed\n");
+  reserve_test();
+  printf("Reserve test passed\n");
+  incremental_resize_test();
+  printf("Incremental resize test passed\n");
+  iteration_test();
+  printf("Iteration test passed\n");
+  build_from_test();
+  printf("Build from test passed\n");
+  parallel_build_test();
+  printf("Parallel build test passed\n");
+  generic_table_test();
+  printf("Generic table test passed\n");
+  set_test();
+  printf("Set test passed\n");
+  key_length_test();
+  printf("Key length test passed\n");
+  snapshot_test();
+  printf("Snapshot test passed\n");
+  stream_test();
+  printf("Stream test passed\n");
+  backend_test();
+  printf("Backend test passed\n");
+  stats_test();
+  printf("Stats test passed\n");
 
   printf("======All tests passed======\n");
   return 0;
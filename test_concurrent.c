@@ -0,0 +1,167 @@
+/*
+ * Tests of the sharded concurrent table. The library is built from all
+ * four sources:
+ *
+ *   gcc -O2 -fopenmp -pthread -o test_concurrent test_concurrent.c swiss_table.c cons/swiss_table.c simd/swiss_table.c parallel/swiss_table.c
+ */
+#include "swiss_table_concurrent.h"
+#include <stdio.h>
+#include <assert.h>
+#include <omp.h>
+
+#define THREAD_COUNT 8
+
+static void
+concurrent_insert_test(void)
+{
+  swiss_table_concurrent_t* tbl = swiss_table_concurrent_init();
+  assert(tbl);
+  const int iter_max = 400000;
+  #pragma omp parallel for num_threads(THREAD_COUNT)
+  for (int i = 0; i < iter_max; ++i) {
+    char tmp[12] = { 0 };
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    int err = swiss_table_concurrent_insert_update(tbl, tmp, tmp);
+    assert(err == NO_ERR);
+    (void)err;
+  }
+  char buf[12];
+  for (int i = 0; i < iter_max; ++i) {
+    char tmp[12] = { 0 };
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    assert(swiss_table_concurrent_get_into(tbl, tmp, buf, sizeof(buf), NULL) == NO_ERR);
+    assert(!strcmp(buf, tmp));
+  }
+  swiss_table_concurrent_destroy(tbl);
+}
+
+static void
+concurrent_mixed_test(void)
+{
+  swiss_table_options_t opts = { 0 };
+  opts.capacity = 100000;
+  swiss_table_concurrent_t* tbl = swiss_table_concurrent_init_opts(&opts, 16);
+  assert(tbl);
+  const int iter_max = 100000;
+  for (int i = 0; i < iter_max; ++i) {
+    char tmp[12] = { 0 };
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    assert(swiss_table_concurrent_insert_update(tbl, tmp, tmp) == NO_ERR);
+  }
+  #pragma omp parallel num_threads(THREAD_COUNT)
+  {
+    int thread = omp_get_thread_num();
+    char tmp[12] = { 0 };
+    char buf[16];
+    for (int i = thread; i < iter_max; i += THREAD_COUNT) {
+      snprintf(tmp, sizeof(tmp), "%d", i);
+      if (i % 2) {
+        int err = swiss_table_concurrent_delete(tbl, tmp);
+        assert(err == NO_ERR);
+        (void)err;
+      } else {
+        int err = swiss_table_concurrent_insert_update(tbl, tmp, "updated");
+        assert(err == UPDATED);
+        (void)err;
+      }
+      snprintf(tmp, sizeof(tmp), "%d", (i * 7919) % iter_max);
+      int err = swiss_table_concurrent_get_into(tbl, tmp, buf, sizeof(buf), NULL);
+      assert(err == NO_ERR || err == KEY_NOT_FOUND);
+      (void)err;
+    }
+  }
+  for (int i = 0; i < iter_max; ++i) {
+    char tmp[12] = { 0 };
+    snprintf(tmp, sizeof(tmp), "%d", i);
+    char* res = swiss_table_concurrent_get_copy(tbl, tmp);
+    assert(i % 2 ? !res : res && !strcmp(res, "updated"));
+    free(res);
+  }
+  assert(swiss_table_concurrent_shrink_to_fit(tbl) == NO_ERR);
+  assert(swiss_table_concurrent_compact(tbl) == NO_ERR);
+  assert(swiss_table_concurrent_reserve(tbl, 2 * iter_max) == NO_ERR);
+  size_t data_len = 0;
+  char* res = swiss_table_concurrent_get_copy_n(tbl, "0", 1, &data_len);
+  assert(res && data_len == strlen("updated"));
+  free(res);
+  swiss_table_concurrent_destroy(tbl);
+}
+
+static void
+strange_args_concurrent_test(void)
+{
+  assert(!swiss_table_concurrent_init_opts(NULL, UINT32_MAX));
+  swiss_table_concurrent_t* tbl = swiss_table_concurrent_init_opts(NULL, 3);
+  assert(tbl);
+  assert(swiss_table_concurrent_insert_update(NULL, "k", "v") == INVALID_ARGS);
+  assert(swiss_table_concurrent_insert_update(tbl, NULL, "v") == INVALID_ARGS);
+  assert(swiss_table_concurrent_delete(tbl, "k") == KEY_NOT_FOUND);
+  assert(!swiss_table_concurrent_get_copy(tbl, "k"));
+  assert(swiss_table_concurrent_insert_update_n(tbl, "k\0k", 3, "v", 1) == NO_ERR);
+  assert(!swiss_table_concurrent_get_copy(tbl, "k"));
+  assert(swiss_table_concurrent_get_into_n(tbl, "k\0k", 3, NULL, 0, NULL) == BUFFER_TOO_SMALL);
+  assert(swiss_table_concurrent_delete_n(tbl, "k\0k", 3) == NO_ERR);
+  swiss_table_concurrent_destroy(tbl);
+}
+
+static void
+concurrent_read_write_test(void)
+{
+  swiss_table_concurrent_t* tbl = swiss_table_concurrent_init_opts(NULL, 4);
+  assert(tbl);
+  const int key_max = 20000;
+  const int round_max = 10;
+  #pragma omp parallel num_threads(THREAD_COUNT)
+  {
+    int thread = omp_get_thread_num();
+    char tmp[12] = { 0 };
+    char expected[16];
+    char buf[16];
+    if (thread < 2) {
+      for (int round = 0; round < round_max; ++round) {
+        for (int i = thread; i < key_max; i += 2) {
+          snprintf(tmp, sizeof(tmp), "%d", i);
+          snprintf(expected, sizeof(expected), "v%d", i);
+          int err = round % 3 == 2 ? swiss_table_concurrent_delete(tbl, tmp) : swiss_table_concurrent_insert_update(tbl, tmp, expected);
+          assert(err == NO_ERR || err == UPDATED || err == KEY_NOT_FOUND);
+          (void)err;
+        }
+        if (thread == 0) {
+          assert(swiss_table_concurrent_compact(tbl) == NO_ERR);
+        }
+      }
+    } else {
+      for (int round = 0; round < round_max; ++round) {
+        for (int i = thread; i < key_max; ++i) {
+          snprintf(tmp, sizeof(tmp), "%d", i);
+          snprintf(expected, sizeof(expected), "v%d", i);
+          size_t data_len = 0;
+          int err = swiss_table_concurrent_get_into(tbl, tmp, buf, sizeof(buf), &data_len);
+          assert(err == KEY_NOT_FOUND || (err == NO_ERR && data_len == strlen(expected) && !strcmp(buf, expected)));
+          (void)err;
+        }
+      }
+    }
+  }
+  swiss_table_concurrent_destroy(tbl);
+}
+
+int
+main(int argc, char** argv)
+{
+  (void)argc;
+  (void)argv;
+  printf("=======Tests started=======\n\n");
+
+  concurrent_insert_test();
+  printf("Concurrent insert test passed\n\n");
+  concurrent_mixed_test();
+  printf("Concurrent mixed test passed\n\n");
+  concurrent_read_write_test();
+  printf("Concurrent read/write test passed\n\n");
+  strange_args_concurrent_test();
+  printf("Strange argument concurrent test passed\n\n");
+
+  printf("======All tests passed======\n");
+  return 0;
+}